@@ -0,0 +1,176 @@
+/* vc8_relay.c
+
+Part of VC8_Remote, under the same licence as vc8_remote.cpp.
+
+*/
+
+/*
+	A relay for the UDP transport (see vc8_udp.h). Run it on or next to the
+	PiDP8I: it takes the VC8 points from the usual TCP port and sends them on as
+	numbered UDP batches to the viewer, and passes the viewer's switch register
+	back.
+	*
+	* Build with: gcc -O2 -o vc8_relay vc8_relay.c
+	* Call with: ./vc8_relay <PiDP8I host>[:port] [udp port]  (both ports default to 2222)
+	* then start the viewer with: ./vc8_remote udp:<relay host>[:udp port]
+	*
+	* A batch is sent when it holds VC8_UDP_MAX_POINTS points, or RELAY_FLUSH_MS
+	* after its first point, whichever comes first.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <endian.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "vc8_udp.h"
+
+#define RELAY_FLUSH_MS 2
+
+static unsigned ms_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char* argv[])
+{
+	struct sockaddr_in addr, peer, from;
+	socklen_t plen = 0, flen;
+	struct hostent* server;
+	struct pollfd pfd[2];
+	struct vc8_udp_header* hdr;
+	uint32_t dg[64], out[(sizeof(struct vc8_udp_header) + VC8_UDP_MAX_POINTS * 4) / 4];	// Words, so the headers are aligned
+	unsigned char in[4096], msg[2], coord[4];
+	char host[256], *colon;
+	unsigned first = 0, seq = 0, sr_seq = 0, have_sr = 0;
+	int tcp, udp, port = 2222, uport = 2222, zeros = 0, ncoord = 0, np = 0, pos = 0, len = 0, n;
+	unsigned p;
+
+	if (argc < 2)
+	{
+		printf("Usage: vc8_relay <PiDP8I host>[:port] [udp port]\n");
+		exit(1);
+	}
+	strncpy(host, argv[1], sizeof(host) - 1);
+	host[sizeof(host) - 1] = 0;
+	if ((colon = strrchr(host, ':')))
+	{
+		*colon = 0;
+		port = atoi(colon + 1);
+	}
+	if (argc > 2)
+		uport = atoi(argv[2]);
+	if (!(server = gethostbyname(host)))
+	{
+		fprintf(stderr, "%s: ", host);
+		perror("ERROR no such host");
+		exit(1);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	memcpy(&addr.sin_addr.s_addr, server->h_addr, server->h_length);
+	addr.sin_port = htons(port);
+	tcp = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (tcp < 0 || connect(tcp, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		fprintf(stderr, "%s: ", host);
+		perror("ERROR connecting");
+		exit(1);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(uport);
+	udp = socket(AF_INET, SOCK_DGRAM, 0);
+	if (udp < 0 || bind(udp, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		perror("ERROR opening the UDP port");
+		exit(1);
+	}
+	printf("Relaying %s:%d to UDP port %d\n", host, port, uport);
+	hdr = (struct vc8_udp_header*)out;
+	pfd[0].fd = tcp;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = udp;
+	pfd[1].events = POLLIN;
+	while (1)
+	{
+		n = poll(pfd, 2, (pos < len) ? 0 : np ? RELAY_FLUSH_MS : 1000);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("ERROR waiting");
+			exit(1);
+		}
+		if (pfd[1].revents & POLLIN)		// The viewer's switch register
+		{
+			struct vc8_udp_header* sr = (struct vc8_udp_header*)dg;
+
+			flen = sizeof(from);
+			n = recvfrom(udp, dg, sizeof(dg), 0, (struct sockaddr*)&from, &flen);
+			if (n >= (int)sizeof(*sr) && sr->type == VC8_UDP_SR && sr->version == VC8_UDP_VERSION)
+			{
+				if (!plen || from.sin_addr.s_addr != peer.sin_addr.s_addr || from.sin_port != peer.sin_port)
+					have_sr = 0;	// A new (or restarted) viewer numbers its changes from the start
+				peer = from;
+				plen = flen;
+				if (!have_sr || (int)(le32toh(sr->seq) - sr_seq) > 0)	// A change, not a copy
+				{
+					sr_seq = le32toh(sr->seq);
+					have_sr = 1;
+					p = le16toh(sr->count);
+					msg[0] = 0;
+					msg[1] = ((p & 0xF00) >> 4) | (p & 0xF);
+					if (send(tcp, msg, 2, 0) != 2)
+						perror("ERROR sending the switch register");
+				}
+			}
+		}
+		if (pos == len && (pfd[0].revents & (POLLIN | POLLHUP)))	// Points from the PiDP8I
+		{
+			len = recv(tcp, in, sizeof(in), 0);
+			pos = 0;
+			if (len <= 0)
+			{
+				printf("%s: Connection closed\n", host);
+				exit(len < 0);
+			}
+		}
+		for (; pos < len && np < VC8_UDP_MAX_POINTS; pos++)	// The rest waits for the next batch
+		{
+			if (zeros < 2)
+			{
+				zeros = in[pos] ? 0 : zeros + 1;
+				continue;
+			}
+			coord[ncoord++] = in[pos] & 0x3f;
+			if (ncoord < 4)
+				continue;
+			p = htole32(((coord[0] | coord[1] << 6) & 1023) | ((coord[2] | coord[3] << 6) & 1023) << 16);
+			out[sizeof(*hdr) / 4 + np] = p;
+			zeros = ncoord = 0;
+			if (!np++)
+				first = ms_now();
+		}
+		if (np && (np == VC8_UDP_MAX_POINTS || ms_now() - first >= RELAY_FLUSH_MS))
+		{
+			hdr->type = VC8_UDP_POINTS;
+			hdr->version = VC8_UDP_VERSION;
+			hdr->count = htole16(np);
+			hdr->seq = htole32(seq++);
+			if (plen)	// Nowhere to send them until the viewer has been heard from
+				sendto(udp, out, sizeof(*hdr) + 4 * np, 0, (struct sockaddr*)&peer, plen);
+			np = 0;
+		}
+	}
+}
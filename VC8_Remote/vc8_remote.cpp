@@ -39,16 +39,114 @@ in this Software without prior written authorization from the author.
 	To exit the app, type 'x' into the calling window.
 	The screen decay constant is set in fade(...). Please change if required. (usual range 1..5).
 	*
+	* Several PiDP8Is may be watched at once: each host gets its own tile in the window.
+	* On Linux a host may also be a serial line: /dev/ttyUSB0 or /dev/ttyUSB0@921600
+	*   (the default is SERIAL_BAUD, any rate the driver accepts may be given). Each
+	*   line has its own receive thread that reads in batches of SERIAL_BATCH bytes.
+	* On Linux a host shm:<name> reads a simulator on the same machine through a
+	*   ring in shared memory rather than TCP. The producer's side is vc8_ring.h.
+	* A host may also be given as tcp:<host>:<port> for another port than 2222, or
+	*   (not on Windows) as unix:/path or unix:@name (Linux abstract name) for a
+	*   simulator listening on a Unix domain socket, which skips the TCP stack.
+	* On Linux a host udp:<relay>[:port] takes the points as numbered UDP batches
+	*   from vc8_relay running next to the PiDP8I, so a lost packet costs a few
+	*   points instead of freezing the picture until TCP sends it again. -S then
+	*   shows the batches lost, duplicated and late. See vc8_udp.h.
+	* Click on a tile (or press TAB) to select which machine receives the key controls.
+	*
+	* The window may be resized freely, F11 toggles full screen.
+	* F12 saves the selected host's tile as vc8_<frame>.png (built with USE_PNG).
 	*
 	* Build with: (Linux, MacOSX) gcc -o vc8_remote vc8_remote.cpp -lSDL2
-	* Call with: ./vc8_remote <PiDP8I host> <-L>
+	* For PNG capture add -DUSE_PNG -lpng -lz (libpng 1.6, as in windows-build).
+	* Call with: ./vc8_remote <PiDP8I host> [<host> ...] <-L> <-j n>
 	* the -L option will double the window size.
+	* the -g WxH option sets the starting window size, -F starts full screen.
+	* the -A n option (n = 2..4) draws at n times the window resolution and filters
+	*   the image down, which smooths the small window at some cost per frame.
+	* the -B option draws each point as a gaussian beam spot rather than a square.
+	* the -a n option adds n (1..255) to the brightness for each hit instead of
+	*   setting it, so spots the program dwells on or repeats glow brighter.
+	* the -P option models the VC8's P7 phosphor: a short blue-white flash followed
+	*   by a long yellow-green afterglow.
+	* the -T option keeps the persistence buffer as 8x8 pixel blocks of one byte, a
+	*   cache line each, so the points of a figure land in few lines. The blocks are
+	*   turned back into rows as the buffer is decayed.
+	* the -R option keeps the points of the last half second in a list and draws
+	*   them as rectangles each frame, dimmer with age, instead of uploading the
+	*   whole tile. This is much cheaper for the sparse Spacewar picture on a big
+	*   window. It uses the square spot, so -A -B -P -T -a and -G are ignored.
+	*   Nothing is drawn into the tile, so there is nothing for F12, -c, -y, -w
+	*   or -e to take either.
+	* the -f option holds back the points of each Spacewar frame and shows them all
+	*   at once, so the picture never has half of one frame and half of the next.
+	*   A frame is taken to end at a pause in the points, when the beam comes back
+	*   to the central star, or when the frame's first point comes round again.
+	*   -S then also shows the frame rate found in the point stream.
+	* the -l option waits until just before the display's next refresh to draw the
+	*   frame, so points that arrive meanwhile are shown a frame sooner. The time
+	*   to draw a frame is measured and the wait cut to match. -S then shows the
+	*   time to spare before the refresh and the frames that missed it.
+	* the -J n option holds the points back n ms (0 = as long as the gaps in the
+	*   points need) and lets them out at a steady rate, for links such as a VPN
+	*   that deliver them in bursts. If the points back up past JB_LIMIT_MS the
+	*   oldest are dropped. -S then shows the delay and the points dropped.
+	* the -D option skips points that land on a pixel already drawn since the last
+	*   decay pass, which Spacewar's central star does a lot. It pays with the
+	*   larger spots of -A and -P. With -a and -B every hit counts, so duplicates
+	*   are only counted. -S then shows the share of duplicates. With the plain
+	*   spot the check costs more than the four stores it saves, so -D is ignored.
+	* At start up each SDL renderer is tried with both ways of loading the tile
+	*   textures (SDL_UpdateTexture or SDL_LockTexture) for a moment, and the
+	*   fastest is used. The choice is kept in tune.txt in the SDL preferences
+	*   folder for the same machine, video driver and display. -X <renderer>[:update|lock]
+	*   forces a choice, e.g. -X software:lock, and -X tune tries them all again.
+	* the -c n option saves every n'th frame of the selected host as a PNG, like F12.
+	*   The frames are copied into a pool of CAPTURE_POOL buffers and written by
+	*   CAPTURE_WORKERS threads, so the display never waits. If the pool is full
+	*   the frame is dropped; -S shows the frames written and dropped.
+	* the -y <file> option records the selected host's tile as Y4M video (4:2:0) at
+	*   the display's frame rate. -y "|command" sends it to a program instead, e.g.
+	*   -y "|ffmpeg -i - spacewar.mp4". The frames are handed to a writer thread
+	*   through a ring of REC_FRAMES buffers; on Linux a pipe is fed with vmsplice().
+	*   -S shows the frames recorded and dropped, and how long the writer waits.
+	* the -w <file> option records the selected host's tile in VC8's own format for
+	*   long sessions: each frame keeps only the REC_TILE x REC_TILE squares that
+	*   changed, run length coded, so the black screen costs next to nothing. It
+	*   uses the same writer as -y, the last of the two given is used. -S also
+	*   shows the size of a frame and the compression against raw RGB.
+	* the -p <file> option plays a -w recording back at its own speed, instead of
+	*   watching a host. At the end it prints how long a frame took to decode.
+	* the -e <name> option (Linux) publishes the selected host's tile in the shared
+	*   memory object /<name> every frame, for other programs to read in place.
+	*   The layout and the reader's side are in vc8_shm.h. -S shows the copy time.
+	* the -G option adds a soft glow around bright spots (F9 toggles it). It is
+	*   switched off by itself if the frames start taking longer than the display allows
+	*   and the glow itself takes more than GLOW_SHARE of that time.
+	* the -j option sets the number of receive threads shared by the hosts (default 1).
+	* the -U option (Linux 6.0 or later) has the receive threads use io_uring: one
+	*   multishot receive per host fills buffers from a ring of URING_BUFS shared
+	*   with the kernel, and the thread only makes a system call when it has
+	*   nothing to do. Without io_uring they go back to select(). -S shows the
+	*   system calls per MB received either way.
+	*
+	* Linux only: thread placement for a busy desktop.
+	* -r <cpus> pins the receive threads (one cpu from the list each), e.g. -r 2,3
+	* -d <cpus> pins the display thread, e.g. -d 1 or -d 0-1, and the -t helpers
+	*    too if the list has a cpu for each band (helpers + 1); if not they float.
+	* -s <fifo|rr|nice>[:n] asks for real time priority n (or nice level n). If the
+	*    user lacks the privilege, real time falls back to nice and nice to normal.
+	* -m locks the app in memory with mlockall() to avoid page faults.
+	* -S prints frame rate, frame time jitter and point rate once a second.
+	* -t <n> sets the number of helper threads for the decay pass on large windows
+	*    (default: one less than the number of cpus, 0 turns them off).
 */
 
 #ifdef _WIN32
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h> // exit()
+#include <math.h>
 #include <SDL.h>
 #else
 #if defined (__linux__) || defined (VMS) || defined (__APPLE__)
@@ -57,11 +155,37 @@ in this Software without prior written authorization from the author.
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
+#include <stddef.h>
 #include <netdb.h>
+#include <math.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_thread.h>
 #include <termios.h>
 #include <unistd.h>
+#include <signal.h>
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined (__linux__)
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <endian.h>
+#include <linux/futex.h>
+#include <linux/serial.h>
+#include <linux/io_uring.h>
+#include "vc8_shm.h"
+#include "vc8_ring.h"
+#include "vc8_udp.h"
+#endif
 int _kbhit(void);
 #endif
 #endif
@@ -81,6 +205,11 @@ extern "C" FILE* __cdecl __iob_func(void)
 }
 #endif
 
+#ifdef USE_PNG
+#include <png.h>
+#include <zlib.h>
+#endif
+
 
 
 #if defined (main)                                  /* Required for SDL */
@@ -88,418 +217,3849 @@ extern "C" FILE* __cdecl __iob_func(void)
 #endif
 
 #define WINDOW_WIDTH 512
-#define MASK (WINDOW_WIDTH * winsize - 1)
+#define MAX_HOSTS 16
+#define MAX_WORKERS 8
+#define RECV_BUFSIZE 4096
+#define URING_BUFS 64			// -U receive buffers of RECV_BUFSIZE per thread, a power of 2
+#define MAX_BANDERS 16
+#define BAND_MIN_PIXELS (512 * 1024)	// Below this a pass is quicker on one thread
+#define PLOT_BATCH 256
+#define STAMP_PITCH 32			// Room for the largest stamp (17 pixels) in whole 16 byte rows
+#define P7_FAST_MS 25			// Decay time constants of the two P7 components
+#define P7_SLOW_MS 600
+#define P7_MAX_MS 100			// Longest frame time in the multiplier tables
+#define RING_SIZE 65536			// -R points kept per host, a power of 2
+#define RING_LIFE_MS 500		// ... and how long they are drawn for
+#define RING_BUCKETS 8			// Brightness steps as the points age
+#define RING_BATCH 1024			// Rectangles per SDL_RenderFillRects call
+#define FRAME_MAX 16384			// -f most points held back for one frame
+#define FRAME_MIN_POINTS 32		// ... fewest before a frame may end
+#define FRAME_GAP_MS 4			// A pause this long ends a frame that has no central star
+#define FRAME_HOLD_MS 50		// ... and this long any frame
+#define FRAME_STAR 12			// Codes from the centre that count as the central star
+#define LATCH_MARGIN_MS 2.0		// -l time kept in hand over the measured drawing time
+#define JB_SIZE 65536			// -J most points held back per host, a power of 2
+#define JB_MIN_MS 20			// ... shortest delay when it is found from the gaps
+#define JB_LIMIT_MS 500			// ... points older than this are dropped
+#define JB_DECAY 0.05			// ... how fast a long gap is forgotten (ms per ms)
+#define GLOW_SHARE 0.25			// -G is turned off when it takes this much of an overrunning frame's budget
+#define DEDUP_DIRTY 4096		// -D words of the bitmap listed for clearing
+#define TUNE_MS 300				// Time allowed for trying the renderers at start up
+#define CAPTURE_POOL 8			// Frames that may wait to be written as PNG
+#define CAPTURE_WORKERS 2		// ... and threads writing them
+#define REC_FRAMES 8			// -y frames that may wait for the writer
+#define REC_TILE 32				// -w squares, compared and coded separately
+#define REC_VERSION 1
+#define SERIAL_BAUD 230400		// Serial line speed unless the host says otherwise
+#define SERIAL_BATCH 64			// Bytes a serial read waits for (VMIN) ...
+#define SERIAL_GAP 1			// ... unless the line goes quiet this long (VTIME, 0.1 s)
+#define RING_SPIN_US 200		// shm: hosts, watch an empty ring this long before sleeping
+#define UDP_BATCHES 32			// udp: hosts, datagrams taken per recvmmsg()
+#define UDP_TICK_MS 10			// ... and the longest wait, for the switch register copies
+#define UDP_RESTART 4096		// ... a batch this far behind starts a new stream (the relay restarted)
+#define UDP_STALE 8				// ... as do this many in a row from behind the window
+
+// Everything needed to show one PiDP8I. One of these per host on the command line.
+struct vc8_session {
+	char host[256];
+	int sockfd;					// ... or the tty of a serial line
+	int serial;
+	struct vc8_ring* shm_ring;	// shm: host, the points come through this
+	int udp;					// udp: host
+	Uint32 udp_next;			// ... the batch expected next
+	Uint64 udp_seen;			// ... which of the 64 batches before it have come
+	Uint32 udp_batches, udp_lost, udp_dups, udp_late;
+	int udp_stale;				// ... batches in a row from behind the window
+	Uint32 sr_seq;				// ... switch register changes sent
+	int sr_copies;				// ... copies of the latest still to send
+	Uint32 sr_sent;				// ... when it was last sent
+	int connected;
+	short sr;
+	SDL_mutex* lock;			// Held while plotting, so the buffer can be replaced on resize
+	SDL_Surface* surface;		// Persistence buffer for this host
+	SDL_Texture* tex;
+	SDL_Rect tile;				// Where this host is drawn in the window
+	Uint8* accum;				// -A/-B/-P intensity buffer, ssample times the tile size
+	Uint8* glow;				// -P afterglow, the same size
+	Uint32* bloom;				// -G horizontally blurred quarter size tile
+	Uint32* bloom_px;			// -G finished glow, uploaded to bloom_tex
+	SDL_Texture* bloom_tex;
+	int xmap[1024];				// VC8 x code -> pixel column (-B: * 4 + quarter pixel)
+	int ymap[1024];				// VC8 y code -> offset of the pixel row (-B: likewise)
+	short xstep[1024];			// -T offset from the spot's first column to its second
+	short ystep[1024];			// ... and from its first row to its second
+	Uint32* ring;				// -R recent points, packed as for plot_points
+	Uint32* ring_t;				// ... and when each arrived (SDL_GetTicks)
+	Uint32 ring_head;			// Count of points put in the ring
+	Uint32* pend;				// -f points of the frame being received, frame number 'frames'
+	int npend;
+	int away;					// ... points since the beam was last at the central star
+	int at_star;				// ... the frame has been to the star
+	int by_star;				// ... the last frame ended back at the star
+	Uint32 last_point;			// ... when the last point arrived
+	Uint32 frames;				// Frames found in the point stream
+	Uint32* jb;					// -J points waiting to be shown
+	Uint32* jb_t;				// ... and when each arrived
+	Uint32 jb_head, jb_tail;	// ... counts of points put in and let out
+	Uint32 jb_last;				// ... when the last batch arrived
+	Uint32 jb_in;				// ... points in since the rate was last measured
+	Uint32 jb_since;			// ... and when that was
+	double jb_rate;				// Arrival rate (points/ms)
+	double jb_credit;			// Points due out but not yet let out
+	double jb_gap;				// Longest recent gap between batches (ms)
+	double jb_target;			// Delay aimed for (ms)
+	Uint32 jb_delay;			// Age of the oldest point held back (ms)
+	Uint32 jb_drops;			// Points dropped
+	Uint32* seen;				// -D pixels drawn since the last decay pass, a bit each
+	Uint32* dirty;				// ... its words that are not 0
+	int ndirty;					// ... how many, above DEDUP_DIRTY if too many to list
+	Uint16 col[1024];			// ... VC8 x code -> pixel column (-A: at n times the tile size)
+	Uint32 row[1024];			// ... VC8 y code -> pixel row * width
+	Uint32 dups;				// Points that landed on a pixel already drawn
+	int zeros;					// Decoder state: count of 0 bytes seen
+	int ncoord;					// Decoder state: coordinate bytes collected
+	unsigned char coord[4];
+	Uint32 points;				// Points decoded, for the -S report
+	Uint32 report_points, report_frames, report_dups;	// ... these counts at the last report
+};
+
+// Frame timing for the -S report. Jitter is the standard deviation of the frame time.
+struct vc8_stats {
+	Uint64 last;				// Performance counter at the last present
+	Uint64 report;				// ... and at the last report
+	int frames;
+	double sum, sumsq, max;		// Frame times (ms)
+	Uint64 pass;				// Time spent in the decay pass (-R: drawing the points)
+	Uint64 bloom;				// ... and building the glow
+	double slack;				// -l time to spare before the refresh (ms)
+	int missed;					// ... frames that missed their refresh
+};
+
+// Frame scheduler for -l. The next refresh is predicted from the times the
+// presents returned, which vsync ties to the refresh.
+struct vc8_sched {
+	double period;				// Refresh period, refined as frames are shown (ms)
+	double work;				// Average time from waking to the present (ms)
+	Uint64 vblank;				// Performance counter when the last present returned
+	Uint64 wake;				// ... and when this frame was started
+};
+
+// A frame copied for the PNG writers.
+struct vc8_capture {
+	Uint32* pixels;
+	int w, h;
+	int size;					// Pixels allocated
+	Uint32 frame;				// Display frame, for the file name
+	int state;					// 0 free, 1 being filled, 2 waiting, 3 being written
+};
+
+typedef void (*band_fn)(vc8_session* s, int y0, int y1);
+
 void changemode(int);
-short keyPressed(char);
-short keyReleased(char);
+short keyPressed(vc8_session*, char);
+short keyReleased(vc8_session*, char);
 
 short old_sr = 0;
-short sr = 0;
 int run_thr = 1;
 SDL_Window* window = NULL;
-SDL_Surface* windowSurface = NULL;
 SDL_Renderer* rend;
-SDL_Texture* tex;
-int sockfd;
+vc8_session sessions[MAX_HOSTS];
+int nsessions = 0;
+int focus = 0;			// Session that receives the key controls
+int nworkers = 1;		// Receive threads, each serving every nworkers'th session
 int winsize = 1;        // Default small window
+int win_w = 0, win_h = 0;	// -g
+int fullscreen = 0;		// -F
+int tile_pixels = 0;	// Total size of the persistence buffers
+int ssample = 1;		// -A Supersampling factor
+int beam = 0;			// -B
+int hit = 0;			// -a Brightness added per point, 0 = set full brightness
+Uint8 flat[STAMP_PITCH];	// -a square spot row for the intensity buffer
+int p7 = 0;				// -P
+int p7_fast[P7_MAX_MS + 1], p7_slow[P7_MAX_MS + 1];	// Decay multipliers (/256) by frame time
+int p7_colour[6] = { 96, 108, 128, 84, 128, 24 };	// Flash and afterglow RGB (/128)
+int frame_ms = 16;		// Time since the last decay pass
+int use_accum = 0;		// Points are drawn into an intensity buffer (-A, -B, -P or -T)
+int tiled = 0;			// -T Intensity buffer held as 8x8 blocks
+int retained = 0;		// -R Points drawn from a list, no tile upload
+int frame_sync = 0;		// -f Plot whole frames of the point stream
+int bloom = 0;			// -G
+double frame_budget = 1000.0 / 60;	// Display refresh period (ms)
+int stamp_size;
+Uint8 stamps[16][STAMP_PITCH * 17];
+const char* recv_cpus = NULL;	// -r
+const char* disp_cpus = NULL;	// -d
+const char* band_cpus = NULL;	// ... and for the band helpers, if it has a cpu for each band
+int sched_policy = 0;	// -s 0 = leave alone, 1 = fifo, 2 = rr, 3 = nice
+int sched_level = 0;	// Real time priority or nice level
+int lock_mem = 0;		// -m
+int show_stats = 0;		// -S
+vc8_stats stats;
+int late_latch = 0;		// -l
+vc8_sched sched;
+int jitter_ms = -1;	// -J Target delay (ms), 0 = found from the gaps, -1 = off
+int dedup = 0;			// -D
+const char* tune_force = NULL;	// -X
+int tex_lock = 0;		// Load the tile textures with SDL_LockTexture
+int capture_every = 0;	// -c
+Uint32 cap_frame = 0;	// Display frames drawn
+Uint32 cap_written = 0, cap_drops = 0;
+vc8_capture cap_pool[CAPTURE_POOL];
+SDL_Thread* cap_thr[CAPTURE_WORKERS];
+SDL_mutex* cap_lock;
+SDL_sem* cap_ready;
+const char* rec_path = NULL;	// -y
+FILE* rec_file = NULL;
+int rec_w, rec_h;		// Size of the recording, the tile rounded down to even
+int rec_size;			// Bytes in a frame, with its "FRAME\n" (-w: the most it can be)
+int rec_tiles = 0;		// -w rather than -y
+int rec_len[REC_FRAMES];	// Bytes used in each buffer
+Uint32* rec_prev = NULL;	// -w: the frame before, to find the squares that changed
+Uint32 rec_start;		// -w: time of the first frame
+Uint64 rec_bytes;		// -w: bytes written
+const char* play_path = NULL;	// -p
+const char* export_name = NULL;	// -e
+#if defined (__linux__)
+vc8_shm_header* shm = NULL;
+#endif
+size_t shm_size;
+Uint64 shm_frames, shm_cost;	// Frames exported and the time copying them out
+int rec_splice = 0;		// Feed the pipe with vmsplice()
+Uint32 rec_spare = 0;	// ... buffers kept back while the pipe may still read them
+Uint8* rec_buf[REC_FRAMES];
+Uint32 rec_head, rec_tail;	// Frames converted and written
+Uint32 rec_drops = 0;
+Uint64 rec_cost, rec_wait;	// Time converting and time the writer spent writing
+double rec_next;		// When the next frame is due (ms)
+SDL_mutex* rec_lock;
+SDL_sem* rec_ready;
+SDL_Thread* rec_thr = NULL;
+int nbanders = -1;		// -t Helper threads for the per-frame passes, -1 = auto
+int use_uring = 0;		// -U
+Uint64 recv_calls[MAX_WORKERS], recv_bytes[MAX_WORKERS];	// System calls and bytes of each receive thread
+SDL_Thread* band_thr[MAX_BANDERS];
+SDL_sem* band_go[MAX_BANDERS];
+SDL_sem* band_done;
+band_fn band_job;
 #ifdef _WIN32
 OVERLAPPED osReader = { 0 }, wtReader = { 0 };
 #endif
 
 
-void fade(SDL_Surface* windowSurface)
+// Decay rows y0..y1-1 of a tile.
+void fade(vc8_session* s, int y0, int y1)
 {
 	int i;
 
-	unsigned char* pixels = (unsigned char*)windowSurface->pixels;
-	int surlen = (WINDOW_WIDTH * windowSurface->pitch) / ((winsize == 1) ? 4 : 2);
+	unsigned char* pixels = (unsigned char*)s->surface->pixels + y0 * s->surface->pitch;
+	int surlen = ((y1 - y0) * s->surface->pitch) / 4;
 	pixels += 1;
 	for (i = 0; i < surlen; i++, pixels += 4)
-		if (*pixels)
-			*pixels -= 8;
-	SDL_Delay(2);
+		*pixels = (*pixels >= 8) ? *pixels - 8 : 0;
 }
 
-void setpixel(SDL_Surface* surface, int ix, int iy, int color)
+// Supersampled mode (-A n): points go into an 8 bit intensity buffer n times the
+// tile size, which is decayed and box filtered down to the tile in one banded pass.
+// Rows y0..y1-1 are tile rows; each covers n rows of the intensity buffer.
+void fade_ss(vc8_session* s, int y0, int y1)
 {
-	Uint32* p;
+	int i, j, x, sum;
+	int n = ssample, aw = s->tile.w * n, w = s->tile.w;
+	int scale = 65536 / (n * n);
+	Uint8* a = s->accum + y0 * n * aw;
+	Uint8* end = s->accum + y1 * n * aw;
+	Uint16* col = SDL_stack_alloc(Uint16, aw);
+	Uint32* out;
 
-	if (!surface)
-		return;
-	unsigned char* pixels = (unsigned char*)surface->pixels;
-
-	ix &= MASK;
-	iy &= MASK;
-	p = (Uint32*)(pixels + (iy * surface->pitch) + (ix * sizeof(Uint32)));
-	*p = color;
+#if defined (__SSE2__)
+	for (; a + 16 <= end; a += 16)
+		_mm_storeu_si128((__m128i*)a, _mm_subs_epu8(_mm_loadu_si128((__m128i*)a), _mm_set1_epi8(8)));
+#endif
+	for (; a < end; a++)
+		*a = (*a >= 8) ? *a - 8 : 0;
 
+	for (; y0 < y1; y0++)
+	{
+		a = s->accum + y0 * n * aw;
+		out = (Uint32*)((Uint8*)s->surface->pixels + y0 * s->surface->pitch);
+		x = 0;
+		if (n == 1)
+		{
+			for (; x < w; x++)
+				out[x] = a[x] << 8;
+			continue;
+		}
+#if defined (__SSE2__)
+		if (n == 2)		// 8 output pixels from 2 rows of 16 bytes
+		{
+			__m128i lo = _mm_set1_epi16(0x00ff), zero = _mm_setzero_si128();
+			__m128i r0, r1, sums;
+			for (; x + 8 <= w; x += 8)
+			{
+				r0 = _mm_loadu_si128((__m128i*)(a + 2 * x));
+				r1 = _mm_loadu_si128((__m128i*)(a + aw + 2 * x));
+				sums = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(r0, lo), _mm_srli_epi16(r0, 8)),
+					_mm_add_epi16(_mm_and_si128(r1, lo), _mm_srli_epi16(r1, 8)));
+				sums = _mm_srli_epi16(sums, 2);
+				_mm_storeu_si128((__m128i*)(out + x), _mm_slli_epi32(_mm_unpacklo_epi16(sums, zero), 8));
+				_mm_storeu_si128((__m128i*)(out + x + 4), _mm_slli_epi32(_mm_unpackhi_epi16(sums, zero), 8));
+			}
+		}
+#endif
+		if (x == w)
+			continue;
+		// Otherwise add up the n rows first, then n columns at a time
+		for (i = x * n; i < aw; i++)
+			col[i] = a[i];
+		for (j = 1; j < n; j++)
+			for (i = x * n; i < aw; i++)
+				col[i] += a[j * aw + i];
+		for (; x < w; x++)
+		{
+			for (i = 0, sum = 0; i < n; i++)
+				sum += col[x * n + i];
+			out[x] = ((sum * scale) >> 16) << 8;
+		}
+	}
+	SDL_stack_free(col);
 }
 
-void sendSR()
+// Blocked intensity buffer (-T). The buffer is a row of 8x8 blocks for each 8 tile
+// rows, each block 64 bytes: one cache line. Rows y0..y1-1 are decayed and copied
+// out to the tile, 8 bytes from each block in turn.
+void fade_tiled(vc8_session* s, int y0, int y1)
 {
-	char buf[2];
-
-	buf[0] = 0; //(sr & 0xF);
-	buf[1] = ((sr & 0xF00) >> 4) | (sr & 0xF);
-	send(sockfd, buf, 2, 0);
-	// printf("SR:%o\r\n",sr);
+	int i, x, w = s->tile.w, bw = (w + 7) & ~7;
+	Uint8* a;
+	Uint32* out;
 
-}
-#ifdef _WIN32
-void PrintCommState(DCB dcb)
-{
-	//  Print some of the DCB structure values
-	printf("\nBaudRate = %d, ByteSize = %d, Parity = %d, StopBits = %d\n",
-		dcb.BaudRate,
-		dcb.ByteSize,
-		dcb.Parity,
-		dcb.StopBits);
+	for (; y0 < y1; y0++)
+	{
+		a = s->accum + (y0 >> 3) * bw * 8 + (y0 & 7) * 8;
+		out = (Uint32*)((Uint8*)s->surface->pixels + y0 * s->surface->pitch);
+		x = 0;
+#if defined (__SSE2__)
+		__m128i zero = _mm_setzero_si128(), v;
+		for (; x + 8 <= w; x += 8, a += 64)
+		{
+			v = _mm_subs_epu8(_mm_loadl_epi64((__m128i*)a), _mm_set1_epi8(8));
+			_mm_storel_epi64((__m128i*)a, v);
+			v = _mm_unpacklo_epi8(v, zero);
+			_mm_storeu_si128((__m128i*)(out + x), _mm_slli_epi32(_mm_unpacklo_epi16(v, zero), 8));
+			_mm_storeu_si128((__m128i*)(out + x + 4), _mm_slli_epi32(_mm_unpackhi_epi16(v, zero), 8));
+		}
+#endif
+		for (; x < w; x += 8, a += 64)
+			for (i = 0; i < 8; i++)
+			{
+				a[i] = (a[i] >= 8) ? a[i] - 8 : 0;
+				if (x + i < w)
+					out[x + i] = a[i] << 8;
+			}
+	}
 }
 
-void ReadSerial(HANDLE hComm, int nBytes, char* buffer) {
-	DWORD bread, eventMask = 0;
+// P7 phosphor (-P). The intensity buffer holds the fast blue-white flash and
+// s->glow the slow yellow-green afterglow, which the flash charges. Each decays by
+// a multiplier looked up for the time since the last frame, and the two are mixed
+// to RGB through the palette colours as the tile is written.
+void init_phosphor()
+{
+	int ms;
 
-	while (nBytes) {
-		while (true) {
-			WaitCommEvent(hComm, &eventMask, NULL);
-			if (EV_RXCHAR & eventMask)
-				break;
-		}
-		ReadFile(hComm, buffer++, 1, &bread, NULL);
-		nBytes--;
+	for (ms = 0; ms <= P7_MAX_MS; ms++)
+	{
+		p7_fast[ms] = (int)(256 * exp(-ms / (double)P7_FAST_MS));
+		p7_slow[ms] = (int)(256 * exp(-ms / (double)P7_SLOW_MS));
 	}
 }
 
-int thr_serial(void* dummy)
+inline Uint32 p7_rgb(int f, int g)
 {
-	HANDLE hComm;
-	DWORD bread;
-	DCB dcb;
-	BOOL fSuccess, rd_wait = FALSE;
-	const TCHAR* pcCommPort = TEXT("\\\\.\\COM19"); //  Most systems have a COM1 port
-	char buffer[256];
-	int k, i = 0;
-	char coord[4];
-	int x, y;
-	COMMTIMEOUTS timeouts;
-	timeouts.ReadIntervalTimeout = MAXDWORD;
-	timeouts.ReadTotalTimeoutMultiplier = 0;
-	timeouts.ReadTotalTimeoutConstant = 0;
-	timeouts.WriteTotalTimeoutMultiplier = 0;
-	timeouts.WriteTotalTimeoutConstant = 0;
-
+	int r = (f * p7_colour[0] + g * p7_colour[3]) >> 7;
+	int gr = (f * p7_colour[1] + g * p7_colour[4]) >> 7;
+	int b = (f * p7_colour[2] + g * p7_colour[5]) >> 7;
 
-	hComm = CreateFile(pcCommPort, GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, NULL, NULL);
-	if (hComm == INVALID_HANDLE_VALUE) {
-		printf("The Comport is closed or taken by other hardware/software!\n\r");
-	}
-	SecureZeroMemory(&dcb, sizeof(DCB));
-	dcb.DCBlength = sizeof(DCB);
+	return (SDL_min(r, 255) << 16) | (SDL_min(gr, 255) << 8) | SDL_min(b, 255);
+}
 
-	//  Build on the current configuration by first retrieving all current
-	//  settings.
-	fSuccess = GetCommState(hComm, &dcb);
+void fade_p7(vc8_session* s, int y0, int y1)
+{
+	int i, j, x, f, g;
+	int n = ssample, aw = s->tile.w * n, w = s->tile.w;
+	int scale = 65536 / (n * n);
+	int mf = p7_fast[frame_ms], ms = p7_slow[frame_ms];
+	int len = (y1 - y0) * n * aw;
+	Uint8* a = s->accum + y0 * n * aw;
+	Uint8* b = s->glow + y0 * n * aw;
+	Uint16* col = SDL_stack_alloc(Uint16, 2 * aw);
+	Uint32* out;
 
-	if (!fSuccess)
+	i = 0;
+#if defined (__SSE2__)
+	__m128i zero = _mm_setzero_si128();
+	__m128i va, vb, lo, hi;
+	for (; i + 16 <= len; i += 16)
 	{
-		//  Handle the error.
-		printf("GetCommState failed with error %d.\n", GetLastError());
-		return (2);
+		va = _mm_loadu_si128((__m128i*)(a + i));
+		vb = _mm_loadu_si128((__m128i*)(b + i));
+		lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), _mm_set1_epi16(ms)), 8);
+		hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), _mm_set1_epi16(ms)), 8);
+		_mm_storeu_si128((__m128i*)(b + i), _mm_max_epu8(_mm_packus_epi16(lo, hi), va));
+		lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), _mm_set1_epi16(mf)), 8);
+		hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), _mm_set1_epi16(mf)), 8);
+		_mm_storeu_si128((__m128i*)(a + i), _mm_packus_epi16(lo, hi));
 	}
-
-	//  Fill in some DCB values and set the com state: 
-	//  57,600 bps, 8 data bits, no parity, and 1 stop bit.
-	dcb.BaudRate = CBR_256000;     //  baud rate
-	dcb.ByteSize = 8;             //  data size, xmit and rcv
-	dcb.Parity = NOPARITY;      //  parity bit
-	dcb.StopBits = ONESTOPBIT;    //  stop bit
-	dcb.fDtrControl = 0;
-	dcb.fRtsControl = 0;
-
-	fSuccess = SetCommState(hComm, &dcb);
-
-	if (!fSuccess)
+#endif
+	for (; i < len; i++)
 	{
-		//  Handle the error.
-		printf("SetCommState failed with error %d.\n", GetLastError());
-		return (3);
+		g = (b[i] * ms) >> 8;
+		b[i] = (g > a[i]) ? g : a[i];
+		a[i] = (a[i] * mf) >> 8;
 	}
-	SetCommTimeouts(hComm, &timeouts);
-	osReader.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-	wtReader.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-	SetCommMask(hComm, EV_RXCHAR);
-	EscapeCommFunction(hComm, SETDTR);
 
-	do {
-		//ReadSerial(hComm, 5, buffer);
-		if (true)
+	for (; y0 < y1; y0++)
+	{
+		a = s->accum + y0 * n * aw;
+		b = s->glow + y0 * n * aw;
+		out = (Uint32*)((Uint8*)s->surface->pixels + y0 * s->surface->pitch);
+		x = 0;
+#if defined (__SSE2__)
+		if (n == 1)		// 8 pixels at a time: each colour is (flash * c1 + glow * c2) >> 7
 		{
-			ReadSerial(hComm, 1, buffer);
-			if (buffer[0] == 0)
-				i++;
-			else
-				i = 0;
-
-			if (i == 2)
+			__m128i r, gr, bl, bg;
+			for (; x + 8 <= w; x += 8)
 			{
-				i = 0;
-				ReadSerial(hComm, 4, buffer);
-				for (k = 0; k < 4; k++)
-					coord[k] = buffer[k] & 0x3f;
-				x = (coord[0] | (coord[1] << 6) + 512) % 1024;
-				y = 1024 - ((coord[2] | (coord[3] << 6) + 512) % 1024);
-				x /= (winsize == 1) ? 2 : 1;
-				y /= (winsize == 1) ? 2 : 1;
-				k = WINDOW_WIDTH * winsize;
-				setpixel(windowSurface, x, y, 0xf800);
-				setpixel(windowSurface, x + 1, y, 0xf800);
-				setpixel(windowSurface, x, y + 1, 0xf800);
-				setpixel(windowSurface, x + 1, y + 1, 0xf800);
-
-				// -------------------------------------------------------
+				va = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)(a + x)), zero);
+				vb = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)(b + x)), zero);
+				r = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(va, _mm_set1_epi16(p7_colour[0])), _mm_mullo_epi16(vb, _mm_set1_epi16(p7_colour[3]))), 7);
+				gr = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(va, _mm_set1_epi16(p7_colour[1])), _mm_mullo_epi16(vb, _mm_set1_epi16(p7_colour[4]))), 7);
+				bl = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(va, _mm_set1_epi16(p7_colour[2])), _mm_mullo_epi16(vb, _mm_set1_epi16(p7_colour[5]))), 7);
+				r = _mm_packus_epi16(r, zero);
+				bg = _mm_unpacklo_epi8(_mm_packus_epi16(bl, zero), _mm_packus_epi16(gr, zero));
+				r = _mm_unpacklo_epi8(r, zero);
+				_mm_storeu_si128((__m128i*)(out + x), _mm_unpacklo_epi16(bg, r));
+				_mm_storeu_si128((__m128i*)(out + x + 4), _mm_unpackhi_epi16(bg, r));
 			}
 		}
-	} while (run_thr);
-	return 0;
-}
 #endif
-
-int thr_recv(void* dummy)
-{
-	char buffer[256];
-	int k, i = 0, n;
-	char coord[4];
-	int x, y, errcode, err = EAGAIN;
-
-	do
-	{
+		if (x == w)
+			continue;
+		for (i = x * n; i < aw; i++)
 		{
-			n = recv(sockfd, buffer, 5, MSG_PEEK);
-			if (errno != EAGAIN)
-				if (n < 0 && errno)
-				{
-					errcode = errno;
-					changemode(0);
-					perror("ERROR receiving from socket");
-					exit(1);
-				}
-
-			if (n >= 5)
+			col[i] = a[i];
+			col[aw + i] = b[i];
+		}
+		for (j = 1; j < n; j++)
+			for (i = x * n; i < aw; i++)
 			{
-				n = recv(sockfd, buffer, 1, 0);
-				if (n < 0)
-				{
-					changemode(0);
-					perror("ERROR reading from socket");
-					exit(1);
-				}
-				if (buffer[0] == 0)
-					i++;
-				else
-					i = 0;
-
-				if (i == 2)
-				{
-					i = 0;
-					n = recv(sockfd, buffer, 4, 0);
-					if (n < 0)
-					{
-						changemode(0);
-						perror("ERROR reading from socket");
-						exit(1);
-					}
-					for (k = 0; k < 4; k++)
-						coord[k] = buffer[k] & 0x3f;
-					x = (coord[0] | (coord[1] << 6) + 512) % 1024;
-					y = 1024 - ((coord[2] | (coord[3] << 6) + 512) % 1024);
-					x /= (winsize == 1) ? 2 : 1;
-					y /= (winsize == 1) ? 2 : 1;
-					k = WINDOW_WIDTH * winsize;
-					setpixel(windowSurface, x, y, 0xf800);
-					setpixel(windowSurface, x + 1, y, 0xf800);
-					setpixel(windowSurface, x, y + 1, 0xf800);
-					setpixel(windowSurface, x + 1, y + 1, 0xf800);
-
-					// -------------------------------------------------------
-				}
+				col[i] += a[j * aw + i];
+				col[aw + i] += b[j * aw + i];
+			}
+		for (; x < w; x++)
+		{
+			for (i = 0, f = 0, g = 0; i < n; i++)
+			{
+				f += col[x * n + i];
+				g += col[aw + x * n + i];
 			}
+			out[x] = p7_rgb((f * scale) >> 16, (g * scale) >> 16);
 		}
-	} while (run_thr);   // Exit flag
-	close(sockfd);
-	return 0;
+	}
+	SDL_stack_free(col);
 }
 
-int main_loop()
+// Glow (-G). A blurred quarter size copy of each tile is drawn over it with additive
+// blending and linear filtering. Building it is two banded passes after the decay:
+// 4x4 downsample plus horizontal blur into s->bloom, then vertical blur into
+// s->bloom_px for upload. s->bloom has 2 zero rows above and below for the blur.
+// The blur is the 1 4 6 4 1 binomial kernel on each colour byte of 4 pixels at once.
+#if defined (__SSE2__)
+inline __m128i tap5(__m128i a, __m128i b, __m128i c, __m128i d, __m128i e)
 {
-	SDL_Event event;
+	return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(a, e),
+		_mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(b, d), 2), _mm_add_epi16(_mm_slli_epi16(c, 2), _mm_slli_epi16(c, 1)))), 4);
+}
 
-	SDL_Init(SDL_INIT_VIDEO);
-	window = SDL_CreateWindow("VC8 Display", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH * winsize, WINDOW_WIDTH * winsize, SDL_WINDOW_SHOWN);
-	windowSurface = SDL_CreateRGBSurface(0, WINDOW_WIDTH * winsize, WINDOW_WIDTH * winsize, 32, 0, 0, 0, 0);
+inline __m128i blur4(const Uint32* p, int step)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i a = _mm_loadu_si128((__m128i*)(p - 2 * step)), b = _mm_loadu_si128((__m128i*)(p - step));
+	__m128i c = _mm_loadu_si128((__m128i*)p), d = _mm_loadu_si128((__m128i*)(p + step));
+	__m128i e = _mm_loadu_si128((__m128i*)(p + 2 * step));
 
-	rend = SDL_GetRenderer(window);
-	if (rend)
-		SDL_DestroyRenderer(rend);
-	SDL_SetHint(SDL_HINT_RENDER_VSYNC, "1");
-	rend = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-	if (!rend)
-		printf("%s\r\n", SDL_GetError());
-	tex = SDL_CreateTextureFromSurface(rend, windowSurface);
-	if (!tex)
-		printf("%s\r\n", SDL_GetError());
+	return _mm_packus_epi16(
+		tap5(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(e, zero)),
+		tap5(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(e, zero)));
+}
+#endif
 
-	if (!tex || !rend || !window || !windowSurface)
-		exit(1);
+inline Uint32 blur1(const Uint32* p, int step)
+{
+	Uint32 out = 0;
+	int c, v;
 
-	while (1)
+	for (c = 0; c < 24; c += 8)
 	{
-		fade(windowSurface);
-		SDL_UpdateTexture(tex, NULL, windowSurface->pixels, windowSurface->pitch);
-		SDL_RenderCopy(rend, tex, NULL, NULL);
-		SDL_RenderPresent(rend);
-		if (SDL_PollEvent(&event))
-			switch (event.type)
+		v = ((p[-2 * step] >> c) & 0xff) + ((p[2 * step] >> c) & 0xff) + 6 * ((p[0] >> c) & 0xff)
+			+ 4 * (((p[-step] >> c) & 0xff) + ((p[step] >> c) & 0xff));
+		out |= (v >> 4) << c;
+	}
+	return out;
+}
+
+void bloom_h(vc8_session* s, int y0, int y1)
+{
+	int x, y, c, k, v, sw = s->tile.w / 4;
+	Uint32* line = SDL_stack_alloc(Uint32, sw + 4);
+	Uint32* src;
+	Uint32* dst;
+
+	line[0] = line[1] = line[sw + 2] = line[sw + 3] = 0;
+	for (y = y0 / 4; y < y1 / 4; y++)
+	{
+		// Sum each 4x4 block per colour and keep twice the average, which is the glow gain
+		src = (Uint32*)((Uint8*)s->surface->pixels + 4 * y * s->surface->pitch);
+		x = 0;
+#if defined (__SSE2__)
+		__m128i zero = _mm_setzero_si128(), r, lo, hi;
+		for (; x < sw; x++)
+		{
+			lo = hi = zero;
+			for (c = 0; c < 4; c++)
 			{
-			case SDL_KEYDOWN:
-				keyPressed(event.key.keysym.sym);
-				if (!event.key.repeat)
-					sendSR();
-				break;
-			case SDL_KEYUP:
-				keyReleased(event.key.keysym.sym);
-				sendSR();
-				break;
-			case SDL_QUIT:
-				return -1;
+				r = _mm_loadu_si128((__m128i*)((Uint8*)(src + 4 * x) + c * s->surface->pitch));
+				lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(r, zero));
+				hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(r, zero));
+			}
+			lo = _mm_add_epi16(lo, hi);
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_si128(lo, 8)), 3);
+			line[x + 2] = _mm_cvtsi128_si32(_mm_packus_epi16(lo, zero));
+		}
+#endif
+		for (; x < sw; x++)
+		{
+			line[x + 2] = 0;
+			for (c = 0; c < 24; c += 8)
+			{
+				for (k = 0, v = 0; k < 16; k++)
+					v += (*(Uint32*)((Uint8*)(src + 4 * x + (k & 3)) + (k >> 2) * s->surface->pitch) >> c) & 0xff;
+				line[x + 2] |= SDL_min(v >> 3, 255) << c;
 			}
+		}
+
+		dst = s->bloom + (y + 2) * sw;
+		x = 0;
+#if defined (__SSE2__)
+		for (; x + 4 <= sw; x += 4)
+			_mm_storeu_si128((__m128i*)(dst + x), blur4(line + x + 2, 1));
+#endif
+		for (; x < sw; x++)
+			dst[x] = blur1(line + x + 2, 1);
 	}
-	return 0;
+	SDL_stack_free(line);
 }
 
-
-int main(int argc, char* argv[])
+void bloom_v(vc8_session* s, int y0, int y1)
 {
+	int x, y, sw = s->tile.w / 4;
+	Uint32* src;
+	Uint32* dst;
 
-	int portno = 2222;
-	struct sockaddr_in serv_addr;
-	struct hostent* server;
-	SDL_Thread* sthrd;
-
-	if (argc != 2 && argc != 3)
+	for (y = y0 / 4; y < y1 / 4; y++)
 	{
-		printf("Usage: vc8_remote <host> <-L>\r\n");
-		exit(1);
+		src = s->bloom + (y + 2) * sw;
+		dst = s->bloom_px + y * sw;
+		x = 0;
+#if defined (__SSE2__)
+		for (; x + 4 <= sw; x += 4)
+			_mm_storeu_si128((__m128i*)(dst + x), blur4(src + x, sw));
+#endif
+		for (; x < sw; x++)
+			dst[x] = blur1(src + x, sw);
 	}
+}
 
-	changemode(1);	// used for kbhit()
-	SDL_Init(SDL_INIT_VIDEO);
+// Gaussian beam spot (-B). Each point adds a precomputed stamp to the intensity
+// buffer with a saturating add. There is one stamp for each quarter pixel offset
+// in x and y, so spots move smoothly without any per point floating point.
+void init_stamps()
+{
+	int p, i, j;
+	double cx, cy, sigma = 0.85 * ssample;
 
-#ifdef USE_SERIAL
+	stamp_size = 4 * ssample + 1;
+	memset(stamps, 0, sizeof(stamps));
+	memset(flat, 0, sizeof(flat));
+	memset(flat, hit, 2 * ssample);
+	for (p = 0; p < 16; p++)
+	{
+		cx = stamp_size / 2 + (p & 3) / 4.0;
+		cy = stamp_size / 2 + (p >> 2) / 4.0;
+		for (j = 0; j < stamp_size; j++)
+			for (i = 0; i < stamp_size; i++)
+				stamps[p][j * STAMP_PITCH + i] = (Uint8)((hit ? hit : 0xf8) * exp(-((i - cx) * (i - cx) + (j - cy) * (j - cy)) / (2 * sigma * sigma)) + 0.5);
+	}
+}
 
-	sthrd = SDL_CreateThread(thr_serial, "ReceiveThread", NULL);
+// Saturating add of one stamp row. The rows are padded with zeros to STAMP_PITCH,
+// and the intensity buffer has slack at the end for the whole 16 byte stores.
+inline void add_row(Uint8* a, const Uint8* st, int size)
+{
+	int i;
 
+#if defined (__SSE2__)
+	for (i = 0; i < size; i += 16)
+		_mm_storeu_si128((__m128i*)(a + i), _mm_adds_epu8(_mm_loadu_si128((__m128i*)(a + i)), _mm_loadu_si128((__m128i*)(st + i))));
 #else
+	int v;
 
-#ifdef _WIN32
-	static WSADATA winsockdata;
-	WSAStartup(MAKEWORD(1, 1), &winsockdata);
-#endif
-
-	// create socket
-	sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	if (sockfd < 0)
-	{
-		perror("ERROR opening socket");
-		exit(1);
-	}
-	server = gethostbyname(argv[1]);
-	if (server == NULL)
+	for (i = 0; i < size; i++)
 	{
-		perror("ERROR no such host");
-		exit(1);
+		v = a[i] + st[i];
+		a[i] = (v > 255) ? 255 : v;
 	}
-#if defined (__linux__)
-	struct timeval timeout;
-	timeout.tv_sec = 1;
-	timeout.tv_usec = 0;
-	setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
-#endif
-#ifdef _WIN32
-	DWORD timeout = 1000;
-	setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
 #endif
-	memset((void*)&serv_addr, '\0', sizeof(serv_addr));
-	serv_addr.sin_family = AF_INET;
-	memcpy((void*)&serv_addr.sin_addr.s_addr, (void*)server->h_addr, server->h_length);
-	serv_addr.sin_port = htons(portno);
-	if (connect(sockfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0)
+}
+
+// Saturating add to the green byte, the only one used in the tile surface.
+inline void add_green(Uint32* p, int v)
+{
+	v += (*p >> 8) & 0xff;
+	*p = ((v > 255) ? 255 : v) << 8;
+}
+
+// Dedup (-D): take out the points whose pixel has been drawn since the last decay
+// pass, as drawing it again changes nothing. With -a or -B each hit adds to
+// the brightness, so the duplicates are only counted. The caller holds s->lock.
+int dedup_points(vc8_session* s, Uint32* pts, int n)
+{
+	int k, m = 0;
+	Uint32 i, bit;
+	Uint32* w;
+
+	for (k = 0; k < n; k++)
 	{
-		perror("ERROR connecting");
-		exit(1);
+		i = s->row[pts[k] >> 16] + s->col[pts[k] & 1023];
+		w = &s->seen[i >> 5];
+		bit = 1u << (i & 31);
+		if (*w & bit)
+		{
+			s->dups++;
+			if (hit || beam)
+				pts[m++] = pts[k];
+			continue;
+		}
+		if (!*w && s->ndirty++ < DEDUP_DIRTY)
+			s->dirty[s->ndirty - 1] = i >> 5;
+		*w |= bit;
+		pts[m++] = pts[k];
 	}
+	return m;
+}
 
-	if (argc == 3)  // Any arg will do!
-		winsize = 2;
+// Start a new frame for -D, clearing only the words of the bitmap that were used
+// unless there were too many to list.
+void dedup_clear(vc8_session* s)
+{
+	int i;
 
-	sthrd = SDL_CreateThread(thr_recv, "ReceiveThread", NULL);
+	SDL_LockMutex(s->lock);
+	if (s->ndirty > DEDUP_DIRTY)
+		memset(s->seen, 0, (s->tile.w * ssample * s->tile.h * ssample + 31) / 32 * sizeof(Uint32));
+	else
+		for (i = 0; i < s->ndirty; i++)
+			s->seen[s->dirty[i]] = 0;
+	s->ndirty = 0;
+	SDL_UnlockMutex(s->lock);
+}
 
-#endif
-	main_loop();
+// Plot a batch of points, each a VC8 x code in the low 16 bits and a y code in the
+// high 16. The caller holds s->lock. The plain spot is 2x2 tile pixels.
+void plot_points(vc8_session* s, Uint32* pts, int n)
+{
+	int i, k, x, y, stride = s->surface->pitch / 4;
+	Uint32* p;
+	Uint8* a;
+	const Uint8* st;
+	Uint32 now;
 
-	run_thr = 0;	// Cause thread to exit;
-	changemode(0);	// used for kbhit()
-	SDL_WaitThread(sthrd, NULL);
-	SDL_DestroyWindow(window);
-	SDL_Quit();
-	return EXIT_SUCCESS;
+	if (dedup)
+		n = dedup_points(s, pts, n);
+	if (retained)
+	{
+		now = SDL_GetTicks();
+		for (k = 0; k < n; k++, s->ring_head++)
+		{
+			s->ring[s->ring_head & (RING_SIZE - 1)] = pts[k];
+			s->ring_t[s->ring_head & (RING_SIZE - 1)] = now;
+		}
+	}
+	else if (beam)
+	{
+		stride = s->tile.w * ssample;
+		for (k = 0; k < n; k++)
+		{
+			x = s->xmap[pts[k] & 1023];
+			y = s->ymap[pts[k] >> 16];
+			a = s->accum + (y >> 2) + (x >> 2);
+			st = stamps[((y & 3) << 2) | (x & 3)];
+			for (i = 0; i < stamp_size; i++, a += stride, st += STAMP_PITCH)
+				add_row(a, st, stamp_size);
+		}
+	}
+	else if (tiled)
+	{
+		for (k = 0; k < n; k++)
+		{
+			a = s->accum + s->ymap[pts[k] >> 16] + s->xmap[pts[k] & 1023];
+			x = s->xstep[pts[k] & 1023];
+			y = s->ystep[pts[k] >> 16];
+			if (hit)
+			{
+				a[0] = SDL_min(255, a[0] + hit);
+				a[x] = SDL_min(255, a[x] + hit);
+				a[y] = SDL_min(255, a[y] + hit);
+				a[x + y] = SDL_min(255, a[x + y] + hit);
+			}
+			else
+				a[0] = a[x] = a[y] = a[x + y] = 0xf8;
+		}
+	}
+	else if (s->accum)
+	{
+		stride = s->tile.w * ssample;
+		for (k = 0; k < n; k++)
+		{
+			a = s->accum + s->ymap[pts[k] >> 16] + s->xmap[pts[k] & 1023];
+			for (i = 0; i < 2 * ssample; i++, a += stride)
+				if (hit)
+					add_row(a, flat, 2 * ssample);
+				else
+					memset(a, 0xf8, 2 * ssample);
+		}
+	}
+	else if (hit)
+	{
+		for (k = 0; k < n; k++)
+		{
+			p = (Uint32*)s->surface->pixels + s->ymap[pts[k] >> 16] + s->xmap[pts[k] & 1023];
+			add_green(p, hit);
+			add_green(p + 1, hit);
+			add_green(p + stride, hit);
+			add_green(p + stride + 1, hit);
+		}
+	}
+	else
+	{
+		for (k = 0; k < n; k++)
+		{
+			p = (Uint32*)s->surface->pixels + s->ymap[pts[k] >> 16] + s->xmap[pts[k] & 1023];
+			p[0] = p[1] = p[stride] = p[stride + 1] = 0xf800;
+		}
+	}
+}
+
+// Retained mode (-R): draw the points of the last RING_LIFE_MS as 2x2 rectangles.
+// The ring is in time order, so each age bucket is a run of it; the buckets are
+// drawn oldest first so the newest points end up on top. The receive thread may
+// overwrite the oldest points meanwhile, which only moves a dim spot.
+void draw_ring(vc8_session* s)
+{
+	SDL_Rect rects[RING_BATCH];
+	Uint32 i, head, now, age, p;
+	int b, n;
+
+	SDL_LockMutex(s->lock);
+	head = s->ring_head;
+	SDL_UnlockMutex(s->lock);
+	now = SDL_GetTicks();
+	i = (head > RING_SIZE) ? head - RING_SIZE : 0;
+	for (; i != head && now - s->ring_t[i & (RING_SIZE - 1)] >= RING_LIFE_MS; i++)
+		;
+	for (b = RING_BUCKETS - 1; b >= 0; b--)
+	{
+		SDL_SetRenderDrawColor(rend, 0, 0xf8 * (RING_BUCKETS - b) / RING_BUCKETS, 0, 0xff);
+		for (n = 0; i != head; i++)
+		{
+			p = s->ring[i & (RING_SIZE - 1)];
+			age = now - s->ring_t[i & (RING_SIZE - 1)];
+			if (age * RING_BUCKETS / RING_LIFE_MS < (Uint32)b)
+				break;
+			rects[n].x = s->tile.x + s->xmap[p & 1023];
+			rects[n].y = s->tile.y + s->ymap[p >> 16];
+			rects[n].w = rects[n].h = 2;
+			if (++n == RING_BATCH)
+			{
+				SDL_RenderFillRects(rend, rects, n);
+				n = 0;
+			}
+		}
+		if (n)
+			SDL_RenderFillRects(rend, rects, n);
+	}
+}
+
+// Frame aligned mode (-f): plot the held back points of a frame in one go. The
+// caller holds s->lock. found is 0 if the frame was cut short, e.g. because
+// no frame boundary turned up before FRAME_MAX points.
+void commit_frame(vc8_session* s, int found)
+{
+	plot_points(s, s->pend, s->npend);
+	s->points += s->npend;
+	s->npend = 0;
+	s->at_star = 0;
+	if (found)
+		s->frames++;
+}
+
+// Add a point to the frame being received, first ending that frame if this
+// point looks like the start of the next one. The network can pause the points
+// in the middle of a frame, so a pause only counts when there is no star to go by.
+// If the star is always there but the beam never seems to leave it, fall back on
+// the pauses after a frame is cut short at FRAME_MAX.
+void frame_point(vc8_session* s, Uint32 p, Uint32 now)
+{
+	int dx = ((p + 512) & 1023) - 512, dy = (((p >> 16) + 512) & 1023) - 512;
+	int star = (SDL_abs(dx) < FRAME_STAR && SDL_abs(dy) < FRAME_STAR);
+
+	if (s->npend >= FRAME_MIN_POINTS && ((star && s->away >= FRAME_MIN_POINTS) || p == s->pend[0]))
+	{
+		s->by_star = 1;
+		commit_frame(s, 1);
+	}
+	else if (s->npend >= FRAME_MIN_POINTS && now - s->last_point >= FRAME_GAP_MS && !(s->at_star && s->by_star))
+		commit_frame(s, 1);
+	else if (s->npend == FRAME_MAX)
+	{
+		s->by_star = 0;
+		commit_frame(s, 0);
+	}
+	s->away = star ? 0 : s->away + 1;
+	s->at_star |= star;
+	s->pend[s->npend++] = p;
+	s->last_point = now;
+}
+
+// Jitter buffer (-J): hold a point back with the time it arrived. If the buffer
+// is full the oldest point is dropped. The caller holds s->lock.
+void jitter_put(vc8_session* s, Uint32 p, Uint32 now)
+{
+	if (s->jb_head - s->jb_tail == JB_SIZE)
+	{
+		s->jb_tail++;
+		s->jb_drops++;
+	}
+	s->jb[s->jb_head & (JB_SIZE - 1)] = p;
+	s->jb_t[s->jb_head & (JB_SIZE - 1)] = now;
+	s->jb_head++;
+	s->jb_in++;
+}
+
+// Let out the points due in the dt ms since the last frame. They go out at the
+// measured arrival rate, sped up or slowed down in proportion to how the age of
+// the oldest point compares with the target delay, so bursts are spread over the
+// gaps between them. If the oldest point is past JB_LIMIT_MS the buffer skips
+// ahead to the target delay.
+void jitter_release(vc8_session* s, int dt)
+{
+	Uint32 pts[PLOT_BATCH];
+	Uint32 now = SDL_GetTicks(), limit;
+	int n, np = 0;
+
+	SDL_LockMutex(s->lock);
+	if (!s->jb_since)
+		s->jb_since = now;
+	if (now - s->jb_since >= 500)
+	{
+		s->jb_rate = s->jb_rate ? 0.5 * s->jb_rate + 0.5 * s->jb_in / (now - s->jb_since) : (double)s->jb_in / (now - s->jb_since);
+		s->jb_in = 0;
+		s->jb_since = now;
+	}
+	s->jb_gap = SDL_max(0, s->jb_gap - dt * JB_DECAY);
+	s->jb_target = jitter_ms ? jitter_ms : SDL_min(SDL_max(JB_MIN_MS, s->jb_gap * 1.5), JB_LIMIT_MS / 2);
+	limit = SDL_max(JB_LIMIT_MS, 2 * (Uint32)s->jb_target);
+	s->jb_delay = (s->jb_head != s->jb_tail) ? now - s->jb_t[s->jb_tail & (JB_SIZE - 1)] : 0;
+	if (s->jb_delay > limit)
+	{
+		while (s->jb_head != s->jb_tail && now - s->jb_t[s->jb_tail & (JB_SIZE - 1)] > s->jb_target)
+		{
+			s->jb_tail++;
+			s->jb_drops++;
+		}
+		s->jb_delay = (Uint32)s->jb_target;
+	}
+	if (s->jb_rate)
+		s->jb_credit += s->jb_rate * dt * SDL_min(2.0, s->jb_delay / s->jb_target);
+	else		// No rate measured yet: let out the points held for the target delay
+	{
+		s->jb_credit = 0;
+		while (s->jb_credit < s->jb_head - s->jb_tail &&
+			now - s->jb_t[(s->jb_tail + (Uint32)s->jb_credit) & (JB_SIZE - 1)] >= s->jb_target)
+			s->jb_credit++;
+	}
+	n = (int)SDL_min(s->jb_credit, (double)(s->jb_head - s->jb_tail));
+	s->jb_credit -= n;
+	if (s->jb_head - s->jb_tail == (Uint32)n)
+		s->jb_credit = 0;
+	for (; n > 0; n--)
+	{
+		pts[np] = s->jb[s->jb_tail++ & (JB_SIZE - 1)];
+		if (frame_sync)
+			frame_point(s, pts[np], now);
+		else if (++np == PLOT_BATCH)
+		{
+			plot_points(s, pts, np);
+			s->points += np;
+			np = 0;
+		}
+	}
+	plot_points(s, pts, np);
+	s->points += np;
+	SDL_UnlockMutex(s->lock);
+}
+
+// Pass points that have arrived on: into the jitter buffer (-J), the frame
+// being collected (-f) or straight into the persistence buffer. Called with
+// s->lock held.
+void deliver(vc8_session* s, Uint32* pts, int n, Uint32 now)
+{
+	int k;
+
+	if (jitter_ms >= 0)
+	{
+		if (s->jb_last && now - s->jb_last > s->jb_gap)
+			s->jb_gap = now - s->jb_last;
+		s->jb_last = now;
+		for (k = 0; k < n; k++)
+			jitter_put(s, pts[k], now);
+		return;
+	}
+	if (frame_sync)
+	{
+		for (k = 0; k < n; k++)
+			frame_point(s, pts[k], now);
+		return;
+	}
+	plot_points(s, pts, n);
+	s->points += n;
+}
+
+// Streaming decoder. A packet is two 0 bytes followed by 4 coordinate bytes.
+// The state is kept in the session so a packet may be split across reads.
+// Points are passed on in batches.
+void decode(vc8_session* s, unsigned char* buffer, int n)
+{
+	Uint32 pts[PLOT_BATCH];
+	Uint32 now = SDL_GetTicks();
+	int k, np = 0;
+
+	SDL_LockMutex(s->lock);
+	if (!s->surface)		// No window yet
+	{
+		SDL_UnlockMutex(s->lock);
+		return;
+	}
+	for (k = 0; k < n; k++)
+	{
+		if (s->zeros < 2)
+		{
+			if (buffer[k] == 0)
+				s->zeros++;
+			else
+				s->zeros = 0;
+			continue;
+		}
+		s->coord[s->ncoord++] = buffer[k] & 0x3f;
+		if (s->ncoord == 4)
+		{
+			pts[np++] = ((s->coord[0] | (s->coord[1] << 6)) & 1023) | (((s->coord[2] | (s->coord[3] << 6)) & 1023) << 16);
+			s->zeros = 0;
+			s->ncoord = 0;
+			if (np == PLOT_BATCH)
+			{
+				deliver(s, pts, np, now);
+				np = 0;
+			}
+		}
+	}
+	deliver(s, pts, np, now);
+	SDL_UnlockMutex(s->lock);
+}
+
+#if defined (__linux__)
+// Send the switch register of a udp: host if a copy is due: VC8_UDP_SR_COPIES
+// of each change, then one every VC8_UDP_KEEPALIVE_MS, which also tells the
+// relay where to send. Called with s->lock held.
+void udp_send_sr(vc8_session* s)
+{
+	vc8_udp_header h;
+	Uint32 now = SDL_GetTicks();
+
+	if (now - s->sr_sent < (Uint32)(s->sr_copies ? VC8_UDP_SR_GAP_MS : VC8_UDP_KEEPALIVE_MS))
+		return;
+	h.type = VC8_UDP_SR;
+	h.version = VC8_UDP_VERSION;
+	h.count = htole16(s->sr);
+	h.seq = htole32(s->sr_seq);
+	send(s->sockfd, (char*)&h, sizeof(h), 0);
+	s->sr_sent = now;
+	if (s->sr_copies)
+		s->sr_copies--;
+}
+#endif
+
+void sendSR(vc8_session* s)
+{
+	char buf[2];
+
+	if (!s->connected)
+		return;
+	buf[0] = 0; //(sr & 0xF);
+	buf[1] = ((s->sr & 0xF00) >> 4) | (s->sr & 0xF);
+#if defined (__linux__)
+	if (s->shm_ring)
+	{
+		s->shm_ring->sr = s->sr;
+		return;
+	}
+	if (s->udp)
+	{
+		SDL_LockMutex(s->lock);
+		s->sr_seq++;
+		s->sr_copies = VC8_UDP_SR_COPIES;
+		s->sr_sent = SDL_GetTicks() - VC8_UDP_SR_GAP_MS;
+		udp_send_sr(s);
+		SDL_UnlockMutex(s->lock);
+		return;
+	}
+	if (s->serial)
+	{
+		if (write(s->sockfd, buf, 2) != 2)
+			perror("ERROR writing to serial line");
+		return;
+	}
+#endif
+	send(s->sockfd, buf, 2, 0);
+	// printf("SR:%o\r\n",sr);
+
+}
+#ifdef _WIN32
+void PrintCommState(DCB dcb)
+{
+	//  Print some of the DCB structure values
+	printf("\nBaudRate = %d, ByteSize = %d, Parity = %d, StopBits = %d\n",
+		dcb.BaudRate,
+		dcb.ByteSize,
+		dcb.Parity,
+		dcb.StopBits);
+}
+
+void ReadSerial(HANDLE hComm, int nBytes, char* buffer) {
+	DWORD bread, eventMask = 0;
+
+	while (nBytes) {
+		while (true) {
+			WaitCommEvent(hComm, &eventMask, NULL);
+			if (EV_RXCHAR & eventMask)
+				break;
+		}
+		ReadFile(hComm, buffer++, 1, &bread, NULL);
+		nBytes--;
+	}
+}
+
+int thr_serial(void* dummy)
+{
+	HANDLE hComm;
+	DWORD bread;
+	DCB dcb;
+	BOOL fSuccess, rd_wait = FALSE;
+	const TCHAR* pcCommPort = TEXT("\\\\.\\COM19"); //  Most systems have a COM1 port
+	unsigned char buffer[256];
+	vc8_session* s = &sessions[0];
+	COMMTIMEOUTS timeouts;
+	timeouts.ReadIntervalTimeout = MAXDWORD;
+	timeouts.ReadTotalTimeoutMultiplier = 0;
+	timeouts.ReadTotalTimeoutConstant = 0;
+	timeouts.WriteTotalTimeoutMultiplier = 0;
+	timeouts.WriteTotalTimeoutConstant = 0;
+
+
+	hComm = CreateFile(pcCommPort, GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, NULL, NULL);
+	if (hComm == INVALID_HANDLE_VALUE) {
+		printf("The Comport is closed or taken by other hardware/software!\n\r");
+	}
+	SecureZeroMemory(&dcb, sizeof(DCB));
+	dcb.DCBlength = sizeof(DCB);
+
+	//  Build on the current configuration by first retrieving all current
+	//  settings.
+	fSuccess = GetCommState(hComm, &dcb);
+
+	if (!fSuccess)
+	{
+		//  Handle the error.
+		printf("GetCommState failed with error %d.\n", GetLastError());
+		return (2);
+	}
+
+	//  Fill in some DCB values and set the com state: 
+	//  57,600 bps, 8 data bits, no parity, and 1 stop bit.
+	dcb.BaudRate = CBR_256000;     //  baud rate
+	dcb.ByteSize = 8;             //  data size, xmit and rcv
+	dcb.Parity = NOPARITY;      //  parity bit
+	dcb.StopBits = ONESTOPBIT;    //  stop bit
+	dcb.fDtrControl = 0;
+	dcb.fRtsControl = 0;
+
+	fSuccess = SetCommState(hComm, &dcb);
+
+	if (!fSuccess)
+	{
+		//  Handle the error.
+		printf("SetCommState failed with error %d.\n", GetLastError());
+		return (3);
+	}
+	SetCommTimeouts(hComm, &timeouts);
+	osReader.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	wtReader.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	SetCommMask(hComm, EV_RXCHAR);
+	EscapeCommFunction(hComm, SETDTR);
+
+	do {
+		ReadSerial(hComm, 1, (char*)buffer);
+		decode(s, buffer, 1);
+	} while (run_thr);
+	return 0;
+}
+#endif
+
+// -s fifo|rr|nice[:n]
+void parse_sched(const char* arg)
+{
+	const char* level = strchr(arg, ':');
+
+	if (!strncmp(arg, "fifo", 4))
+		sched_policy = 1, sched_level = 10;
+	else if (!strncmp(arg, "rr", 2))
+		sched_policy = 2, sched_level = 10;
+	else if (!strncmp(arg, "nice", 4))
+		sched_policy = 3, sched_level = -10;
+	else
+		printf("Unknown scheduling policy %s ignored\r\n", arg);
+	if (sched_policy && level)
+		sched_level = atoi(level + 1);
+}
+
+#if defined (__linux__)
+// Called once everything is allocated. Future mappings are only locked when the
+// memlock limit cannot bite, otherwise a later thread stack or malloc would fail.
+void lock_memory()
+{
+	struct rlimit lim;
+	int flags = MCL_CURRENT;
+
+	if (!lock_mem)
+		return;
+	if (geteuid() == 0 || (!getrlimit(RLIMIT_MEMLOCK, &lim) && lim.rlim_cur == RLIM_INFINITY))
+		flags |= MCL_FUTURE;
+	if (mlockall(flags))
+		perror("mlockall (continuing unlocked)");
+	else
+		printf("Memory locked%s\r\n", (flags & MCL_FUTURE) ? "" : " (current pages only)");
+}
+
+// Parse a cpu list such as "2" or "0,2-3". Returns the number of cpus in the set.
+int parse_cpus(const char* list, cpu_set_t* set)
+{
+	int lo, hi, n;
+
+	CPU_ZERO(set);
+	while (*list)
+	{
+		if (sscanf(list, "%d%n", &lo, &n) != 1)
+			break;
+		list += n;
+		hi = lo;
+		if (*list == '-' && sscanf(list + 1, "%d%n", &hi, &n) == 1)
+			list += n + 1;
+		for (; lo <= hi; lo++)
+			if (lo >= 0 && lo < CPU_SETSIZE)
+				CPU_SET(lo, set);
+		if (*list == ',')
+			list++;
+	}
+	return CPU_COUNT(set);
+}
+
+// Apply the -r/-d/-s options to the calling thread and report what it actually got.
+// index picks one cpu from the list for each receive thread, -1 uses the whole list.
+int count_cpus(const char* list)
+{
+	cpu_set_t set;
+
+	return parse_cpus(list, &set);
+}
+
+void place_thread(const char* name, const char* cpus, int index)
+{
+	cpu_set_t set;
+	struct sched_param param;
+	int i, n, policy, got;
+	pid_t tid = syscall(SYS_gettid);
+	char desc[256];
+
+	if (cpus)
+	{
+		n = parse_cpus(cpus, &set);
+		if (n && index >= 0)
+		{
+			index %= n;
+			for (i = 0; i < CPU_SETSIZE; i++)
+				if (CPU_ISSET(i, &set) && index-- != 0)
+					CPU_CLR(i, &set);
+		}
+		if (!n || pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+			printf("%s: cannot pin to cpus %s\r\n", name, cpus);
+	}
+	if (sched_policy == 1 || sched_policy == 2)
+	{
+		policy = (sched_policy == 1) ? SCHED_FIFO : SCHED_RR;
+		param.sched_priority = sched_level;
+		if (pthread_setschedparam(pthread_self(), policy, &param))
+		{
+			printf("%s: no real time priority (%s), trying nice -10\r\n", name, strerror(errno));
+			if (setpriority(PRIO_PROCESS, tid, -10))
+				printf("%s: nice -10 refused too, running at normal priority\r\n", name);
+		}
+	}
+	else if (sched_policy == 3 && setpriority(PRIO_PROCESS, tid, sched_level))
+		printf("%s: nice %d refused (%s), running at normal priority\r\n", name, sched_level, strerror(errno));
+
+	if (!cpus && !sched_policy)
+		return;
+	// Report the effective setup rather than what was asked for
+	pthread_getschedparam(pthread_self(), &policy, &param);
+	pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+	n = snprintf(desc, sizeof(desc), "%s: %s", name,
+		policy == SCHED_FIFO ? "SCHED_FIFO" : policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER");
+	if (policy == SCHED_FIFO || policy == SCHED_RR)
+		n += snprintf(desc + n, sizeof(desc) - n, " priority %d", param.sched_priority);
+	else
+		n += snprintf(desc + n, sizeof(desc) - n, " nice %d", getpriority(PRIO_PROCESS, tid));
+	n += snprintf(desc + n, sizeof(desc) - n, ", cpus");
+	for (i = 0, got = 0; i < CPU_SETSIZE && n < (int)sizeof(desc) - 8; i++)
+		if (CPU_ISSET(i, &set))
+			n += snprintf(desc + n, sizeof(desc) - n, "%s%d", got++ ? "," : " ", i);
+	printf("%s\r\n", desc);
+}
+#else
+void lock_memory()
+{
+	if (lock_mem)
+		printf("-m is only supported on Linux\r\n");
+}
+
+void place_thread(const char* name, const char* cpus, int index)
+{
+	if (cpus || sched_policy)
+		printf("%s: thread placement is only supported on Linux\r\n", name);
+}
+
+int count_cpus(const char* list)
+{
+	return 0;
+}
+#endif
+
+// Drop a host that has gone away. The last one to go takes the app with it.
+void disconnect(vc8_session* s, const char* msg)
+{
+	SDL_Event quit;
+	int i, live = 0;
+
+	fprintf(stderr, "%s: ", s->host);
+	if (msg)
+		perror(msg);
+	else
+		fprintf(stderr, "Connection closed\n");
+	s->connected = 0;
+	close(s->sockfd);
+	for (i = 0; i < nsessions; i++)
+		live += sessions[i].connected;
+	if (!live)		// Leave through main()'s shutdown, so recordings and exports are finished
+	{
+		SDL_zero(quit);
+		quit.type = SDL_QUIT;
+		SDL_PushEvent(&quit);
+	}
+}
+
+#if defined (__linux__)
+// A receive thread's io_uring (-U), used through the raw system calls.
+struct vc8_uring {
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	struct io_uring_buf* br;		// Buffers the kernel may fill. Not io_uring_buf_ring: in C++ its bufs[] starts 8 bytes late
+	unsigned char* bufs;
+	Uint16 br_tail;
+	unsigned queued;				// Requests not yet submitted
+	void* sq_ring;
+	void* cq_ring;
+	size_t sq_len, cq_len, sqes_len;
+};
+
+// Undo uring_setup(), however far it got.
+void uring_free(vc8_uring* u)
+{
+	if (u->br)
+		munmap(u->br, URING_BUFS * sizeof(struct io_uring_buf));
+	SDL_free(u->bufs);
+	if (u->sqes)
+		munmap(u->sqes, u->sqes_len);
+	if (u->cq_ring && u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_len);
+	if (u->sq_ring)
+		munmap(u->sq_ring, u->sq_len);
+	if (u->fd >= 0)
+		close(u->fd);
+}
+
+// Hand buffer bid back to the kernel. It sees it at the next release of br->tail.
+void uring_give(vc8_uring* u, int bid)
+{
+	struct io_uring_buf* b = &u->br[u->br_tail & (URING_BUFS - 1)];
+
+	b->addr = (Uint64)(uintptr_t)(u->bufs + bid * RECV_BUFSIZE);
+	b->len = RECV_BUFSIZE;
+	b->bid = bid;
+	u->br_tail++;
+}
+
+// Make the ring and register URING_BUFS buffers as buffer group bgid.
+// Returns 0, with errno set, if the kernel cannot.
+int uring_setup(vc8_uring* u, int bgid)
+{
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	int i;
+
+	memset(u, 0, sizeof(*u));
+	memset(&p, 0, sizeof(p));
+	if ((u->fd = syscall(__NR_io_uring_setup, 2 * MAX_HOSTS, &p)) < 0)
+		return 0;
+	u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		u->sq_len = u->cq_len = SDL_max(u->sq_len, u->cq_len);
+	u->sq_ring = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ring == MAP_FAILED)
+	{
+		u->sq_ring = NULL;
+		return 0;
+	}
+	u->cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP) ? u->sq_ring :
+		mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+	if (u->cq_ring == MAP_FAILED)
+	{
+		u->cq_ring = NULL;
+		return 0;
+	}
+	u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = (struct io_uring_sqe*)mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED)
+	{
+		u->sqes = NULL;
+		return 0;
+	}
+	u->sq_tail = (unsigned*)((char*)u->sq_ring + p.sq_off.tail);
+	u->sq_mask = (unsigned*)((char*)u->sq_ring + p.sq_off.ring_mask);
+	u->sq_array = (unsigned*)((char*)u->sq_ring + p.sq_off.array);
+	u->cq_head = (unsigned*)((char*)u->cq_ring + p.cq_off.head);
+	u->cq_tail = (unsigned*)((char*)u->cq_ring + p.cq_off.tail);
+	u->cq_mask = (unsigned*)((char*)u->cq_ring + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe*)((char*)u->cq_ring + p.cq_off.cqes);
+
+	u->br = (struct io_uring_buf*)mmap(NULL, URING_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (u->br == MAP_FAILED)
+	{
+		u->br = NULL;
+		return 0;
+	}
+	if (!(u->bufs = (unsigned char*)SDL_malloc(URING_BUFS * RECV_BUFSIZE)))
+		return 0;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (Uint64)(uintptr_t)u->br;
+	reg.ring_entries = URING_BUFS;
+	reg.bgid = bgid;
+	if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		return 0;
+	for (i = 0; i < URING_BUFS; i++)
+		uring_give(u, i);
+	__atomic_store_n(&((struct io_uring_buf_ring*)u->br)->tail, u->br_tail, __ATOMIC_RELEASE);
+	return 1;
+}
+
+// Queue a multishot receive on session i: it keeps completing, one buffer of
+// group bgid at a time, until the socket closes, fails or the buffers run out.
+void uring_arm(vc8_uring* u, int i, int bgid)
+{
+	unsigned tail = *u->sq_tail;
+	struct io_uring_sqe* sqe = &u->sqes[tail & *u->sq_mask];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = sessions[i].sockfd;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bgid;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->user_data = i;
+	u->sq_array[tail & *u->sq_mask] = tail & *u->sq_mask;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	u->queued++;
+}
+
+// -U receive loop for worker's hosts. The completions that are ready are all
+// taken before anything else: the buffers decoded, given back together, and
+// ended receives queued again. Only when there are none does the thread submit
+// and wait in one io_uring_enter(), at most a second so it sees the exit flag.
+// Returns 0 if io_uring cannot be used, and thr_recv() goes on with select().
+int uring_recv(int worker)
+{
+	vc8_uring u;
+	struct io_uring_cqe* cqe;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned head, tail;
+	int i, n, res, live, data = 0;
+	vc8_session* s;
+
+	if (!uring_setup(&u, worker))
+	{
+		if (!worker)
+			printf("io_uring is not available (%s), using select()\r\n", strerror(errno));
+		uring_free(&u);
+		return 0;
+	}
+	for (i = worker; i < nsessions; i += nworkers)
+		if (sessions[i].connected && sessions[i].sockfd >= 0 && !sessions[i].serial && !sessions[i].udp)
+			uring_arm(&u, i, worker);
+	memset(&arg, 0, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+	arg.ts = (Uint64)(uintptr_t)&ts;
+	while (run_thr)
+	{
+		head = *u.cq_head;
+		tail = __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE);
+		if (head == tail)
+		{
+			for (i = worker, live = 0; i < nsessions; i += nworkers)
+				live += sessions[i].connected && sessions[i].sockfd >= 0 && !sessions[i].serial && !sessions[i].udp;
+			if (!live)
+				break;
+			ts.tv_sec = 1;
+			ts.tv_nsec = 0;
+			n = syscall(__NR_io_uring_enter, u.fd, u.queued, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+			recv_calls[worker]++;
+			if (n >= 0)
+				u.queued = 0;
+			else if (errno != ETIME && errno != EINTR && errno != EBUSY)
+			{
+				changemode(0);
+				perror("ERROR waiting on io_uring");
+				exit(1);
+			}
+			continue;
+		}
+		for (; head != tail; head++)
+		{
+			cqe = &u.cqes[head & *u.cq_mask];
+			s = &sessions[cqe->user_data];
+			res = cqe->res;
+			if (res > 0)
+			{
+				decode(s, u.bufs + (cqe->flags >> IORING_CQE_BUFFER_SHIFT) * RECV_BUFSIZE, res);
+				uring_give(&u, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+				recv_bytes[worker] += res;
+				data = 1;
+			}
+			if (cqe->flags & IORING_CQE_F_MORE)
+				continue;
+			if (res == -EINVAL && !data)	// No multishot receive before Linux 6.0
+			{
+				__atomic_store_n(u.cq_head, head + 1, __ATOMIC_RELEASE);
+				if (!worker)
+					printf("io_uring cannot receive multishot, using select()\r\n");
+				uring_free(&u);
+				return 0;
+			}
+			if (!s->connected)
+				continue;
+			if (res == 0)
+				disconnect(s, NULL);
+			else if (res < 0 && res != -ENOBUFS && res != -EINTR)
+			{
+				errno = -res;
+				disconnect(s, "ERROR reading from socket");
+			}
+			else	// Out of buffers for a moment: they are given back below
+				uring_arm(&u, s - sessions, worker);
+		}
+		__atomic_store_n(u.cq_head, head, __ATOMIC_RELEASE);
+		__atomic_store_n(&((struct io_uring_buf_ring*)u.br)->tail, u.br_tail, __ATOMIC_RELEASE);
+	}
+	for (i = worker; i < nsessions; i += nworkers)
+		if (sessions[i].connected && sessions[i].sockfd >= 0 && !sessions[i].serial && !sessions[i].udp)
+			close(sessions[i].sockfd);
+	uring_free(&u);
+	return 1;
+}
+#else
+int uring_recv(int worker)
+{
+	if (!worker)
+		printf("-U is only supported on Linux\r\n");
+	return 0;
+}
+#endif
+
+// Receive thread. Each one waits on its share of the hosts with select()
+// and decodes whatever has arrived in bulk, so one thread can serve many machines.
+int thr_recv(void* arg)
+{
+	unsigned char buffer[RECV_BUFSIZE];
+	int worker = (int)(intptr_t)arg;
+	int i, n, len, maxfd;
+	fd_set rdfs;
+	struct timeval tv;
+	vc8_session* s;
+	char name[32];
+
+	snprintf(name, sizeof(name), "ReceiveThread %d", worker);
+	place_thread(name, recv_cpus, worker);
+	if (use_uring && uring_recv(worker))
+		return 0;
+	do
+	{
+		FD_ZERO(&rdfs);
+		maxfd = -1;
+		for (i = worker; i < nsessions; i += nworkers)
+			if (sessions[i].connected && sessions[i].sockfd >= 0 && !sessions[i].serial && !sessions[i].udp)
+			{
+				FD_SET(sessions[i].sockfd, &rdfs);
+				if (sessions[i].sockfd > maxfd)
+					maxfd = sessions[i].sockfd;
+			}
+		if (maxfd < 0)
+			break;
+		tv.tv_sec = 1;		// Wake up now and then to check the exit flag
+		tv.tv_usec = 0;
+		n = select(maxfd + 1, &rdfs, NULL, NULL, &tv);
+		recv_calls[worker]++;
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			changemode(0);
+			perror("ERROR waiting on sockets");
+			exit(1);
+		}
+		for (i = worker; n > 0 && i < nsessions; i += nworkers)
+		{
+			s = &sessions[i];
+			if (!s->connected || s->serial || s->udp || s->sockfd < 0 || !FD_ISSET(s->sockfd, &rdfs))
+				continue;
+			n--;
+			len = recv(s->sockfd, (char*)buffer, sizeof(buffer), 0);
+			recv_calls[worker]++;
+			if (len > 0)
+			{
+				decode(s, buffer, len);
+				recv_bytes[worker] += len;
+			}
+			else if (len == 0)
+				disconnect(s, NULL);
+			else if (errno != EAGAIN && errno != EINTR)
+				disconnect(s, "ERROR reading from socket");
+		}
+	} while (run_thr);   // Exit flag
+	for (i = worker; i < nsessions; i += nworkers)
+		if (sessions[i].connected && sessions[i].sockfd >= 0 && !sessions[i].serial && !sessions[i].udp)
+			close(sessions[i].sockfd);
+	return 0;
+}
+
+#if defined (__linux__)
+// struct termios2 of <asm/termbits.h>, which cannot be included with <termios.h>.
+// It takes the baud rate as a number, for rates with no Bxxx constant.
+struct vc8_termios2 {
+	tcflag_t c_iflag, c_oflag, c_cflag, c_lflag;
+	cc_t c_line;
+	cc_t c_cc[19];
+	speed_t c_ispeed, c_ospeed;
+};
+#define VC8_TCGETS2 _IOR('T', 0x2A, struct vc8_termios2)
+#define VC8_TCSETS2 _IOW('T', 0x2B, struct vc8_termios2)
+#define VC8_BOTHER 0010000
+
+// Open a /dev/tty[@baud] host: raw 8N1 with no flow control. A read returns
+// once SERIAL_BATCH bytes are in, or the line has paused for SERIAL_GAP, so the
+// thread wakes once a batch rather than once a byte. The driver is asked to
+// pass bytes on at once (low latency, e.g. the FTDI 16 ms timer down to 1 ms).
+// Report why dev could not be set up, and close it. Returns 0 for open_serial().
+int serial_failed(vc8_session* s, const char* dev, const char* msg)
+{
+	if (msg)
+		fprintf(stderr, "%s: ", dev);
+	perror(msg ? msg : dev);
+	if (s->sockfd >= 0)
+		close(s->sockfd);
+	s->sockfd = -1;
+	return 0;
+}
+
+int open_serial(vc8_session* s)
+{
+	static const struct { int baud; speed_t code; } rates[] = {
+		{ 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+		{ 230400, B230400 }, { 460800, B460800 }, { 500000, B500000 }, { 576000, B576000 },
+		{ 921600, B921600 }, { 1000000, B1000000 }, { 1152000, B1152000 }, { 1500000, B1500000 },
+		{ 2000000, B2000000 }, { 3000000, B3000000 }, { 4000000, B4000000 } };
+	struct termios tio;
+	struct vc8_termios2 tio2;
+	struct serial_struct ss;
+	char dev[256], *at;
+	int i, baud = SERIAL_BAUD, custom = 1, low = 0;
+
+	strncpy(dev, s->host, sizeof(dev) - 1);
+	dev[sizeof(dev) - 1] = 0;
+	if ((at = strchr(dev, '@')))
+	{
+		*at = 0;
+		baud = atoi(at + 1);
+	}
+	s->sockfd = open(dev, O_RDWR | O_NOCTTY);
+	if (s->sockfd < 0 || tcgetattr(s->sockfd, &tio))
+		return serial_failed(s, dev, NULL);
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+	tio.c_iflag &= ~(IXON | IXOFF | IXANY);
+	tio.c_cc[VMIN] = SERIAL_BATCH;
+	tio.c_cc[VTIME] = SERIAL_GAP;
+	for (i = 0; i < (int)(sizeof(rates) / sizeof(rates[0])); i++)
+		if (rates[i].baud == baud)
+		{
+			cfsetispeed(&tio, rates[i].code);
+			cfsetospeed(&tio, rates[i].code);
+			custom = 0;
+		}
+	if (tcsetattr(s->sockfd, TCSANOW, &tio))
+		return serial_failed(s, dev, NULL);
+	if (custom)
+	{
+		if (ioctl(s->sockfd, VC8_TCGETS2, &tio2) < 0)
+			return serial_failed(s, dev, NULL);
+		tio2.c_cflag = (tio2.c_cflag & ~CBAUD) | VC8_BOTHER;
+		tio2.c_ispeed = tio2.c_ospeed = baud;
+		if (ioctl(s->sockfd, VC8_TCSETS2, &tio2) < 0 || ioctl(s->sockfd, VC8_TCGETS2, &tio2) < 0)
+			return serial_failed(s, dev, "ERROR setting the baud rate");
+		baud = tio2.c_ospeed;
+	}
+	if (!ioctl(s->sockfd, TIOCGSERIAL, &ss))
+	{
+		ss.flags |= ASYNC_LOW_LATENCY;
+		low = !ioctl(s->sockfd, TIOCSSERIAL, &ss);
+	}
+	tcflush(s->sockfd, TCIOFLUSH);
+	printf("%s: %d baud%s\r\n", dev, baud, low ? ", low latency" : "");
+	s->serial = 1;
+	s->connected = 1;
+	return 1;
+}
+
+// Receive thread of a serial line. poll() wakes it at the first byte (and
+// lets it see the exit flag), the read then waits for the rest of the batch.
+int thr_serial(void* arg)
+{
+	unsigned char buffer[RECV_BUFSIZE];
+	vc8_session* s = (vc8_session*)arg;
+	struct pollfd pfd;
+	int len;
+
+	place_thread("SerialThread", recv_cpus, s - sessions);
+	pfd.fd = s->sockfd;
+	pfd.events = POLLIN;
+	while (run_thr && s->connected)
+	{
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+		len = read(s->sockfd, buffer, sizeof(buffer));
+		if (len > 0)
+			decode(s, buffer, len);
+		else if (len == 0 || (errno != EAGAIN && errno != EINTR))
+			disconnect(s, len ? "ERROR reading from serial line" : NULL);
+	}
+	if (s->connected)
+		close(s->sockfd);
+	return 0;
+}
+
+// Attach to the ring of a shm:<name> host, made by the simulator.
+int open_ring(vc8_session* s)
+{
+	char path[256] = "/";
+	struct stat st;
+	vc8_ring* r;
+	void* p;
+	int fd;
+
+	strncat(path, s->host + 4, sizeof(path) - 2);
+	if ((fd = shm_open(path, O_RDWR, 0)) < 0 || fstat(fd, &st))
+	{
+		perror(path);
+		return 0;
+	}
+	p = (st.st_size >= (off_t)sizeof(vc8_ring)) ? mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	r = (vc8_ring*)p;
+	if (p == MAP_FAILED || __atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != VC8_RING_MAGIC || r->version != VC8_RING_VERSION
+		|| !r->size || (r->size & (r->size - 1)) || sizeof(vc8_ring) + r->size * sizeof(Uint32) > (size_t)st.st_size)
+	{
+		printf("%s: not a VC8 point ring\r\n", path);
+		return 0;
+	}
+	r->tail = r->head;		// Start with what comes next
+	s->shm_ring = r;
+	s->sockfd = -1;
+	s->connected = 1;
+	return 1;
+}
+
+// Receive thread of a shm: host. It takes the points in batches, copied out of
+// the ring so a hostile producer cannot reach past the tables and -D cannot
+// write into its memory. When the ring is empty it watches head for RING_SPIN_US
+// (if there is another cpu for the producer) and only then sleeps on the head futex, for the producer to wake it. So while
+// points keep coming closer together than that, neither side makes a system call
+// for them. A wait that times out checks the producer is alive.
+int thr_ring(void* arg)
+{
+	vc8_session* s = (vc8_session*)arg;
+	vc8_ring* r = s->shm_ring;
+	Uint32 pts[PLOT_BATCH];
+	Uint32 mask = r->size - 1, head, tail = r->tail, n, k;
+	Uint64 spin = (SDL_GetCPUCount() > 1) ? SDL_GetPerformanceFrequency() * RING_SPIN_US / 1000000 : 0, t;	// One cpu: the producer cannot run while we spin
+	struct timespec ts;
+
+	place_thread("RingThread", recv_cpus, s - sessions);
+	while (run_thr && s->connected)
+	{
+		head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		if (head == tail)
+		{
+			if (r->closed)
+			{
+				disconnect(s, NULL);
+				break;
+			}
+			t = SDL_GetPerformanceCounter();
+			while ((head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) == tail && SDL_GetPerformanceCounter() - t < spin)
+#if defined (__SSE2__)
+				_mm_pause();
+#else
+				;
+#endif
+			if (head != tail)
+				continue;
+			__atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+			ts.tv_sec = 1;
+			ts.tv_nsec = 0;
+			if (__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == tail
+				&& syscall(SYS_futex, &r->head, FUTEX_WAIT, tail, &ts, NULL, 0) && errno == ETIMEDOUT
+				&& kill(r->pid, 0) && errno == ESRCH)
+			{
+				disconnect(s, NULL);
+				break;
+			}
+			r->waiting = 0;
+			continue;
+		}
+		if (head - tail > r->size)	// A producer that overran the ring: skip to what it wrote last
+			tail = head - r->size;
+		SDL_LockMutex(s->lock);
+		if (s->surface)		// Otherwise no window yet, the points are dropped
+			for (; tail != head; tail += n)
+			{
+				n = SDL_min(head - tail, PLOT_BATCH);
+				for (k = 0; k < n; k++)
+					pts[k] = r->points[(tail + k) & mask] & 0x03ff03ff;
+				deliver(s, pts, n, SDL_GetTicks());
+			}
+		SDL_UnlockMutex(s->lock);
+		__atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+		tail = head;
+	}
+	return 0;
+}
+
+// Open a udp:<relay>[:port] host. The socket is connected to the relay, so
+// nothing from anywhere else gets in. The first switch register datagram tells
+// the relay to start sending.
+int open_udp(vc8_session* s, int portno)
+{
+	struct sockaddr_in addr;
+	struct hostent* server;
+	char name[256], *colon;
+	int size = 1 << 20;
+
+	strncpy(name, s->host + 4, sizeof(name) - 1);
+	name[sizeof(name) - 1] = 0;
+	if ((colon = strrchr(name, ':')))
+	{
+		*colon = 0;
+		portno = atoi(colon + 1);
+	}
+	if (!(server = gethostbyname(name)))
+	{
+		fprintf(stderr, "%s: ", s->host);
+		perror("ERROR no such host");
+		return 0;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	memcpy(&addr.sin_addr.s_addr, server->h_addr, server->h_length);
+	addr.sin_port = htons(portno);
+	s->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s->sockfd < 0 || connect(s->sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		fprintf(stderr, "%s: ", s->host);
+		perror("ERROR connecting");
+		return 0;
+	}
+	setsockopt(s->sockfd, SOL_SOCKET, SO_RCVBUF, (char*)&size, sizeof(size));	// Room for a burst
+	s->udp = 1;
+	s->connected = 1;
+	sendSR(s);
+	return 1;
+}
+
+// Count a batch by its sequence number: in order, after a gap (the missing
+// ones are counted lost), or behind the newest, where it is either a late one
+// that was counted lost (it is plotted anyway) or a duplicate (it is not).
+// A restarted relay numbers from 0 again: batches far behind, or a run of them
+// behind the window, start the count again instead of being thrown away.
+// Returns 0 for a duplicate.
+int udp_count(vc8_session* s, Uint32 seq)
+{
+	int d = (int)(seq - s->udp_next);
+
+	if (s->udp_batches && (d < -UDP_RESTART || (d < -64 && ++s->udp_stale >= UDP_STALE)))
+	{
+		fprintf(stderr, "%s: The relay has restarted\n", s->host);
+		s->udp_batches = 0;
+	}
+	if (!s->udp_batches++)
+	{
+		d = 0;
+		s->udp_seen = 0;
+	}
+	if (d >= -64)
+		s->udp_stale = 0;
+	if (d >= 0)
+	{
+		s->udp_lost += d;
+		s->udp_seen = (d >= 63) ? 1 : (s->udp_seen << (d + 1)) | 1;
+		s->udp_next = seq + 1;
+		return 1;
+	}
+	if (d < -64 || (s->udp_seen >> (-d - 1) & 1))
+	{
+		s->udp_dups++;
+		return 0;
+	}
+	s->udp_seen |= 1ULL << (-d - 1);
+	s->udp_late++;
+	if (s->udp_lost)	// Not if it came from before the first
+		s->udp_lost--;
+	return 1;
+}
+
+// Receive thread of a udp: host. recvmmsg() takes all the datagrams waiting,
+// up to UDP_BATCHES, in one call, and whatever has arrived is plotted at once.
+int thr_udp(void* arg)
+{
+	vc8_session* s = (vc8_session*)arg;
+	static Uint32 bufs[MAX_HOSTS][UDP_BATCHES][(sizeof(vc8_udp_header) + VC8_UDP_MAX_POINTS * 4) / 4];	// Words, so the points are aligned
+	struct mmsghdr msgs[UDP_BATCHES];
+	struct iovec iov[UDP_BATCHES];
+	struct pollfd pfd;
+	vc8_udp_header* h;
+	Uint32* pts;
+	Uint32 now;
+	int i, k, n;
+
+	place_thread("UdpThread", recv_cpus, s - sessions);
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < UDP_BATCHES; i++)
+	{
+		iov[i].iov_base = bufs[s - sessions][i];
+		iov[i].iov_len = sizeof(bufs[0][0]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	pfd.fd = s->sockfd;
+	pfd.events = POLLIN;
+	while (run_thr && s->connected)
+	{
+		n = poll(&pfd, 1, UDP_TICK_MS);
+		SDL_LockMutex(s->lock);
+		udp_send_sr(s);
+		SDL_UnlockMutex(s->lock);
+		if (n <= 0)
+			continue;
+		n = recvmmsg(s->sockfd, msgs, UDP_BATCHES, MSG_DONTWAIT, NULL);
+		if (n < 0)
+		{
+			if (errno != EAGAIN && errno != EINTR && errno != ECONNREFUSED)	// Refused: no relay yet
+				disconnect(s, "ERROR reading from socket");
+			continue;
+		}
+		now = SDL_GetTicks();
+		SDL_LockMutex(s->lock);
+		for (i = 0; i < n; i++)
+		{
+			h = (vc8_udp_header*)bufs[s - sessions][i];
+			pts = bufs[s - sessions][i] + sizeof(*h) / 4;
+			if (msgs[i].msg_len < sizeof(*h) || h->type != VC8_UDP_POINTS || h->version != VC8_UDP_VERSION)
+				continue;
+			h->count = le16toh(h->count);
+			h->seq = le32toh(h->seq);
+			if (h->count > VC8_UDP_MAX_POINTS || msgs[i].msg_len < sizeof(*h) + h->count * 4u || !udp_count(s, h->seq))
+				continue;
+			for (k = 0; k < h->count; k++)
+				pts[k] = le32toh(pts[k]) & 0x03ff03ff;
+			if (s->surface)
+				deliver(s, pts, h->count, now);
+		}
+		SDL_UnlockMutex(s->lock);
+	}
+	if (s->connected)
+		close(s->sockfd);
+	return 0;
+}
+#endif
+
+// Select the session that receives the key controls. Any switches still held
+// down on the old one are released so a ship is not left thrusting.
+void set_focus(int n)
+{
+	char title[300];
+
+	if (n < 0 || n >= nsessions)
+		return;
+	if (n != focus && sessions[focus].sr)
+	{
+		sessions[focus].sr = 0;
+		sendSR(&sessions[focus]);
+	}
+	focus = n;
+	snprintf(title, sizeof(title), "VC8 Display - %s", sessions[focus].host);
+	SDL_SetWindowTitle(window, title);
+}
+
+// Called after each present. Accumulates frame times and prints the -S line once a second.
+void frame_stats(Uint64 pass, Uint64 glow)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+	double freq = (double)SDL_GetPerformanceFrequency();
+	double ms, mean, jitter;
+	static Uint64 last_calls, last_bytes;
+	Uint32 points = 0, dups = 0;
+	Uint64 calls, bytes, wait;
+	Uint32 written;
+	int i;
+
+	if (stats.last)
+	{
+		ms = (now - stats.last) * 1000.0 / freq;
+		stats.sum += ms;
+		stats.sumsq += ms * ms;
+		if (ms > stats.max)
+			stats.max = ms;
+		stats.frames++;
+		stats.pass += pass;
+		stats.bloom += glow;
+	}
+	else
+		stats.report = now;
+	stats.last = now;
+	if (now - stats.report < SDL_GetPerformanceFrequency())
+		return;
+
+	// The glow is the first thing to go when frames run over the refresh period,
+	// but only if the blur passes themselves are a real part of the overrun
+	ms = stats.frames ? stats.bloom * 1000.0 / freq / stats.frames : 0;
+	if (bloom && stats.frames && stats.sum / stats.frames > frame_budget * 1.25 && ms > frame_budget * GLOW_SHARE)
+	{
+		printf("Glow turned off: it takes %.2f ms of %.2f ms frames, the display allows %.2f ms\r\n", ms, stats.sum / stats.frames, frame_budget);
+		bloom = 0;
+	}
+	if (show_stats && stats.frames)
+	{
+		mean = stats.sum / stats.frames;
+		jitter = stats.sumsq / stats.frames - mean * mean;
+		jitter = (jitter > 0) ? SDL_sqrt(jitter) : 0;
+		for (i = 0; i < nsessions; i++)	// Since the last report, counted per host so -S stays right across set_focus()
+		{
+			points += sessions[i].points - sessions[i].report_points;
+			dups += sessions[i].dups - sessions[i].report_dups;
+			sessions[i].report_points = sessions[i].points;
+			sessions[i].report_dups = sessions[i].dups;
+		}
+		printf("%.1f fps  frame %.2f ms  jitter %.2f ms  max %.2f ms  decay %.2f ms  glow %.2f ms  %u points/s",
+			stats.frames * freq / (now - stats.report), mean, jitter, stats.max,
+			stats.pass * 1000.0 / freq / stats.frames, stats.bloom * 1000.0 / freq / stats.frames, points);
+		if (frame_sync)		// The frame rate of the program on the selected host
+			printf("  program %.1f fps", (sessions[focus].frames - sessions[focus].report_frames) * freq / (now - stats.report));
+		if (late_latch)
+			printf("  slack %.2f ms  missed %d", stats.slack / stats.frames, stats.missed);
+		for (i = 0, calls = bytes = 0; i < MAX_WORKERS; i++)
+		{
+			calls += recv_calls[i];
+			bytes += recv_bytes[i];
+		}
+		if (bytes > last_bytes)
+			printf("  %.0f syscalls/MB", (calls - last_calls) * 1048576.0 / (bytes - last_bytes));
+		last_calls = calls;
+		last_bytes = bytes;
+		if (sessions[focus].udp)
+			printf("  batches %u lost %u dup %u late %u", sessions[focus].udp_batches, sessions[focus].udp_lost,
+				sessions[focus].udp_dups, sessions[focus].udp_late);
+		if (jitter_ms >= 0)	// The jitter buffer of the selected host
+			printf("  delay %u ms  target %.0f ms  dropped %u", sessions[focus].jb_delay, sessions[focus].jb_target, sessions[focus].jb_drops);
+		if (rec_thr)
+		{
+			SDL_LockMutex(rec_lock);	// Taken from the writer thread's counts
+			written = rec_tail;
+			wait = rec_wait;
+			bytes = rec_bytes;
+			rec_wait = 0;
+			SDL_UnlockMutex(rec_lock);
+			printf("  recorded %u dropped %u  convert %.2f ms  writer busy %.0f%%", written, rec_drops,
+				rec_head ? rec_cost * 1000.0 / freq / rec_head : 0.0, wait * 100.0 / (now - stats.report));
+			if (rec_tiles && written && bytes)
+				printf("  %.1f KB/frame (%.0f:1)", bytes / 1024.0 / written, (double)written * rec_w * rec_h * 3 / bytes);
+		}
+		if (export_name)
+			printf("  export %.2f ms", shm_cost * 1000.0 / freq / stats.frames);
+		shm_cost = 0;
+		if (capture_every || cap_written || cap_drops)
+			printf("  captured %u dropped %u", cap_written, cap_drops);
+		if (dedup)
+			printf("  dup %.1f%%", points ? dups * 100.0 / points : 0.0);
+		printf("\r\n");
+		for (i = 0; i < nsessions; i++)
+			sessions[i].report_frames = sessions[i].frames;
+	}
+	memset(&stats, 0, sizeof(stats));
+	stats.last = stats.report = now;
+}
+
+// Sleep until the drawing of the next frame has to start to be done in time
+// for the predicted refresh.
+void sched_wait()
+{
+	double freq = (double)SDL_GetPerformanceFrequency();
+	double ms = ((double)sched.vblank - (double)SDL_GetPerformanceCounter()) * 1000.0 / freq;
+
+	ms += sched.period - sched.work - LATCH_MARGIN_MS;
+	if (sched.vblank && ms >= 1)
+		SDL_Delay((Uint32)ms);
+	sched.wake = SDL_GetPerformanceCounter();
+}
+
+// Called with the counter just before the present: time the drawing, note the
+// slack before the refresh, and take the refresh time from the present. If the
+// present did not wait, vsync is not working and the predicted time is kept.
+void sched_presented(Uint64 before)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+	double freq = (double)SDL_GetPerformanceFrequency();
+	double ms = (now - sched.vblank) * 1000.0 / freq;
+	Uint64 deadline = sched.vblank + (Uint64)(sched.period * freq / 1000);
+
+	sched.work = 0.9 * sched.work + 0.1 * (before - sched.wake) * 1000.0 / freq;
+	if (!sched.vblank)
+	{
+		sched.vblank = now;
+		return;
+	}
+	stats.slack += ((double)deadline - (double)before) * 1000.0 / freq;
+	if (ms > sched.period * 1.5)
+		stats.missed++;
+	if ((now - before) * 1000.0 / freq < 0.5)
+		sched.vblank = SDL_max(now, deadline);
+	else
+	{
+		if (ms > sched.period * 0.5 && ms < sched.period * 1.5)
+			sched.period = 0.95 * sched.period + 0.05 * ms;
+		sched.vblank = now;
+	}
+}
+
+#ifdef USE_PNG
+// Write one captured frame. The tile is mostly black with a few bright spots, so
+// the rows are not filtered and zlib is asked for run length coding only: about
+// half the time of the usual settings, for files a third bigger. The file gets
+// its name once it is complete, so a frame cut off at exit leaves no broken PNG.
+void write_png(vc8_capture* c)
+{
+	char name[32], tmp[40];
+	png_structp png;
+	png_infop info = NULL;
+	FILE* f;
+	int y;
+
+	SDL_snprintf(name, sizeof(name), "vc8_%06u.png", c->frame);
+	SDL_snprintf(tmp, sizeof(tmp), "%s.part", name);
+	if (!(f = fopen(tmp, "wb")))
+	{
+		perror(tmp);
+		return;
+	}
+	png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (png)
+		info = png_create_info_struct(png);
+	if (!info || setjmp(png_jmpbuf(png)))
+	{
+		printf("%s: PNG write failed\r\n", name);
+		png_destroy_write_struct(&png, &info);
+		fclose(f);
+		remove(tmp);
+		return;
+	}
+	png_init_io(png, f);
+	png_set_IHDR(png, info, c->w, c->h, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_set_filter(png, 0, PNG_FILTER_NONE);
+	png_set_compression_strategy(png, Z_RLE);
+	png_write_info(png, info);
+	png_set_filler(png, 0, PNG_FILLER_AFTER);	// RGB888 is B G R x in memory
+	png_set_bgr(png);
+	for (y = 0; y < c->h; y++)
+		png_write_row(png, (png_bytep)(c->pixels + y * c->w));
+	png_write_end(png, NULL);
+	png_destroy_write_struct(&png, &info);
+	fclose(f);
+	remove(name);		// For Windows, where rename will not replace a file
+	if (rename(tmp, name))
+		perror(name);
+}
+
+// PNG writer thread: take the oldest waiting frame. A wake up with nothing
+// waiting is the signal to stop, posted once the frames before it are taken.
+int thr_capture(void* arg)
+{
+	vc8_capture* c;
+	int i;
+
+	while (1)
+	{
+		SDL_SemWait(cap_ready);
+		SDL_LockMutex(cap_lock);
+		for (c = NULL, i = 0; i < CAPTURE_POOL; i++)
+			if (cap_pool[i].state == 2 && (!c || cap_pool[i].frame < c->frame))
+				c = &cap_pool[i];
+		if (c)
+			c->state = 3;
+		SDL_UnlockMutex(cap_lock);
+		if (!c)
+			return 0;
+		write_png(c);
+		SDL_LockMutex(cap_lock);
+		c->state = 0;
+		cap_written++;
+		SDL_UnlockMutex(cap_lock);
+	}
+}
+
+void start_capture()
+{
+	int i;
+
+	cap_lock = SDL_CreateMutex();
+	cap_ready = SDL_CreateSemaphore(0);
+	for (i = 0; i < CAPTURE_WORKERS; i++)
+		cap_thr[i] = SDL_CreateThread(thr_capture, "CaptureThread", NULL);
+}
+
+// Let the writers finish the frames already taken, then stop them.
+void stop_capture()
+{
+	int i;
+
+	for (i = 0; i < CAPTURE_WORKERS; i++)
+		SDL_SemPost(cap_ready);
+	for (i = 0; i < CAPTURE_WORKERS; i++)
+		SDL_WaitThread(cap_thr[i], NULL);
+}
+
+// Copy a host's tile into a free buffer of the pool for the writers. This is
+// the only cost to the display thread; if no buffer is free the frame is dropped.
+void capture_frame(vc8_session* s)
+{
+	vc8_capture* c = NULL;
+	int i, w = s->surface->w, h = s->surface->h;
+
+	SDL_LockMutex(cap_lock);
+	for (i = 0; i < CAPTURE_POOL && !c; i++)
+		if (cap_pool[i].state == 0)
+			c = &cap_pool[i];
+	if (c)
+		c->state = 1;
+	else
+		cap_drops++;
+	SDL_UnlockMutex(cap_lock);
+	if (!c)
+		return;
+	if (c->size < w * h)
+	{
+		SDL_free(c->pixels);
+		c->size = (c->pixels = (Uint32*)SDL_malloc(w * h * sizeof(Uint32))) ? w * h : 0;
+	}
+	if (!c->pixels)
+	{
+		SDL_LockMutex(cap_lock);
+		c->state = 0;
+		cap_drops++;
+		SDL_UnlockMutex(cap_lock);
+		return;
+	}
+	if (frame_sync)		// Whole frames only
+		SDL_LockMutex(s->lock);
+	for (i = 0; i < h; i++)
+		memcpy(c->pixels + i * w, (Uint8*)s->surface->pixels + i * s->surface->pitch, w * sizeof(Uint32));
+	if (frame_sync)
+		SDL_UnlockMutex(s->lock);
+	c->w = w;
+	c->h = h;
+	c->frame = cap_frame;
+	SDL_LockMutex(cap_lock);
+	c->state = 2;
+	SDL_UnlockMutex(cap_lock);
+	SDL_SemPost(cap_ready);
+}
+#else
+void start_capture()
+{
+}
+
+void stop_capture()
+{
+}
+
+void capture_frame(vc8_session* s)
+{
+	static int told;
+
+	if (!told++)
+		printf("PNG capture needs a build with USE_PNG\r\n");
+}
+#endif
+
+// Convert a tile to full range BT.601 4:2:0 (the Y4M C420jpeg layout). w and h
+// are even. Y is worked out 4 pixels at a time and U and V from the 2x2 averages.
+void rgb_to_i420(const Uint8* src, int pitch, int w, int h, Uint8* py, Uint8* pu, Uint8* pv)
+{
+	const Uint8 *p, *q;
+	int i, j, x, b, g, r;
+
+	for (j = 0; j < h; j += 2)
+	{
+		p = src + j * pitch;
+		q = p + pitch;
+		x = 0;
+#if defined (__SSE2__)
+		__m128i zero = _mm_setzero_si128(), half = _mm_set1_epi32(128), c256 = _mm_set1_epi32(256);
+		__m128i wy = _mm_set_epi16(0, 77, 150, 29, 0, 77, 150, 29);
+		__m128i wu = _mm_set_epi16(0, -43, -85, 128, 0, -43, -85, 128);
+		__m128i wv = _mm_set_epi16(0, 128, -107, -21, 0, 128, -107, -21);
+		__m128i a, b0, b1, m0, m1, y, c, u, v;
+		for (; x + 4 <= w; x += 4)
+		{
+			for (i = 0; i < 2; i++)
+			{
+				a = _mm_loadu_si128((__m128i*)((i ? q : p) + 4 * x));
+				m0 = _mm_madd_epi16(_mm_unpacklo_epi8(a, zero), wy);
+				m1 = _mm_madd_epi16(_mm_unpackhi_epi8(a, zero), wy);
+				y = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(m0), _mm_castsi128_ps(m1), _MM_SHUFFLE(2, 0, 2, 0))),
+					_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(m0), _mm_castsi128_ps(m1), _MM_SHUFFLE(3, 1, 3, 1))));
+				y = _mm_srli_epi32(_mm_add_epi32(y, half), 8);
+				y = _mm_packs_epi32(y, y);
+				*(Uint32*)(py + (j + i) * w + x) = _mm_cvtsi128_si32(_mm_packus_epi16(y, y));
+			}
+			// Two 2x2 blocks: average the rows, then add the pixel pairs
+			a = _mm_avg_epu8(_mm_loadu_si128((__m128i*)(p + 4 * x)), _mm_loadu_si128((__m128i*)(q + 4 * x)));
+			b0 = _mm_unpacklo_epi8(a, zero);
+			b1 = _mm_unpackhi_epi8(a, zero);
+			c = _mm_unpacklo_epi64(_mm_add_epi16(b0, _mm_srli_si128(b0, 8)), _mm_add_epi16(b1, _mm_srli_si128(b1, 8)));
+			u = _mm_madd_epi16(c, wu);
+			v = _mm_madd_epi16(c, wv);
+			u = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(u, _mm_srli_epi64(u, 32)), c256), 9);
+			v = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(v, _mm_srli_epi64(v, 32)), c256), 9);
+			i = j / 2 * (w / 2) + x / 2;
+			pu[i] = SDL_max(0, SDL_min(255, _mm_cvtsi128_si32(u) + 128));
+			pu[i + 1] = SDL_max(0, SDL_min(255, _mm_cvtsi128_si32(_mm_srli_si128(u, 8)) + 128));
+			pv[i] = SDL_max(0, SDL_min(255, _mm_cvtsi128_si32(v) + 128));
+			pv[i + 1] = SDL_max(0, SDL_min(255, _mm_cvtsi128_si32(_mm_srli_si128(v, 8)) + 128));
+		}
+#endif
+		for (; x < w; x += 2)
+		{
+			for (i = 0, b = g = r = 0; i < 4; i++)
+			{
+				const Uint8* px = ((i & 2) ? q : p) + 4 * (x + (i & 1));
+				py[(j + (i >> 1)) * w + x + (i & 1)] = (77 * px[2] + 150 * px[1] + 29 * px[0] + 128) >> 8;
+				b += px[0];
+				g += px[1];
+				r += px[2];
+			}
+			i = j / 2 * (w / 2) + x / 2;
+			pu[i] = SDL_max(0, SDL_min(255, ((128 * b - 85 * g - 43 * r + 512) >> 10) + 128));
+			pv[i] = SDL_max(0, SDL_min(255, ((128 * r - 107 * g - 21 * b + 512) >> 10) + 128));
+		}
+	}
+}
+
+// Write one recorded frame. A pipe is given the pages themselves by vmsplice();
+// the buffer is not reused until enough frames have followed it to push it out
+// of the pipe (rec_spare).
+int write_frame(Uint8* buf, int len)
+{
+#if defined (__linux__)
+	struct iovec iov;
+	ssize_t n;
+
+	if (rec_splice)
+	{
+		iov.iov_base = buf;
+		iov.iov_len = len;
+		while (iov.iov_len)
+		{
+			n = vmsplice(fileno(rec_file), &iov, 1, 0);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return 0;
+			iov.iov_base = (Uint8*)iov.iov_base + n;
+			iov.iov_len -= n;
+		}
+		return 1;
+	}
+#endif
+	return fwrite(buf, 1, len, rec_file) == (size_t)len;
+}
+
+// Recorder thread: write the frames in order. A wake up with no frame waiting
+// is the signal to stop.
+int thr_record(void* arg)
+{
+	Uint8* buf;
+	Uint64 t;
+	int ok, len;
+
+	while (1)
+	{
+		SDL_SemWait(rec_ready);
+		SDL_LockMutex(rec_lock);
+		buf = (rec_tail != rec_head) ? rec_buf[rec_tail % REC_FRAMES] : NULL;
+		len = rec_len[rec_tail % REC_FRAMES];
+		SDL_UnlockMutex(rec_lock);
+		if (!buf)
+			return 0;
+		t = SDL_GetPerformanceCounter();
+		ok = write_frame(buf, len);
+		t = SDL_GetPerformanceCounter() - t;
+		if (!ok)
+		{
+			perror("Recording stopped");
+			rec_path = NULL;
+			return 0;
+		}
+		SDL_LockMutex(rec_lock);		// frame_stats() reads these under the lock too
+		rec_tail++;
+		rec_wait += t;
+		rec_bytes += len;
+		SDL_UnlockMutex(rec_lock);
+	}
+}
+
+// The -w format, all numbers little endian:
+//   header: "VC8R", version, REC_TILE, width, height (16 bits each), frame period in us (32)
+//   frame:  bytes that follow (32), ms since the start (32), squares (16), then for each
+//           square its index (16), its bytes (16) and its pixels, run length coded.
+// A square is coded as a row of pixels, left to right and top to bottom, in
+// runs: a byte n < 0x80 is n + 1 copies of the pixel that follows, n >= 0x80 is
+// n - 0x7f different pixels. A pixel is 3 bytes, blue green red.
+void put16(Uint8* p, Uint32 v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+void put32(Uint8* p, Uint32 v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+Uint32 get16(const Uint8* p)
+{
+	return p[0] | p[1] << 8;
+}
+
+Uint32 get32(const Uint8* p)
+{
+	return get16(p) | get16(p + 2) << 16;
+}
+
+// Code one w x h square of pixels (pitch in pixels). Returns the bytes used,
+// which is never more than w * h * 3 + (w * h + 127) / 128.
+int rle_encode(const Uint32* px, int pitch, int w, int h, Uint8* out)
+{
+	Uint32 buf[REC_TILE * REC_TILE];
+	Uint8* o = out;
+	Uint8* lit = NULL;
+	int i, j, n = w * h;
+
+	for (j = 0; j < h; j++)		// Gather the square into one row
+		for (i = 0; i < w; i++)
+			buf[j * w + i] = px[j * pitch + i] & 0xffffff;
+	for (i = 0; i < n; i += j)
+	{
+		for (j = 1; i + j < n && j < 128 && buf[i + j] == buf[i]; j++)
+			;
+		if (j == 1 && lit && *lit < 0xff)	// Add to the run of different pixels
+			(*lit)++;
+		else if (j == 1)
+		{
+			lit = o++;
+			*lit = 0x80;
+		}
+		else
+		{
+			lit = NULL;
+			*o++ = j - 1;
+		}
+		*o++ = buf[i];
+		*o++ = buf[i] >> 8;
+		*o++ = buf[i] >> 16;
+	}
+	return o - out;
+}
+
+// Decode a square coded by rle_encode(). Returns 0 if the data is bad.
+int rle_decode(const Uint8* in, int len, Uint32* px, int pitch, int w, int h)
+{
+	const Uint8* end = in + len;
+	Uint32 c;
+	int n = w * h, i = 0, k, lit;
+
+	while (in < end && i < n)
+	{
+		lit = *in >= 0x80;
+		k = lit ? *in - 0x7f : *in + 1;
+		in++;
+		if (i + k > n || end - in < (lit ? 3 * k : 3))
+			return 0;
+		for (; k; k--, i++)
+		{
+			c = in[0] | in[1] << 8 | in[2] << 16;
+			if (lit || k == 1)
+				in += 3;
+			px[i / w * pitch + i % w] = c;
+		}
+	}
+	return i == n && in == end;
+}
+
+// Code the squares of the tile that changed since the last frame into buf.
+// Returns the bytes used.
+int encode_tiles(vc8_session* s, Uint8* buf)
+{
+	const Uint32* px = (const Uint32*)s->surface->pixels;
+	int pitch = s->surface->pitch / sizeof(Uint32);
+	int x, y, j, w, h, n = 0, len = 10;
+
+	for (y = 0; y < rec_h; y += REC_TILE)
+		for (x = 0; x < rec_w; x += REC_TILE)
+		{
+			w = SDL_min(REC_TILE, rec_w - x);
+			h = SDL_min(REC_TILE, rec_h - y);
+			for (j = 0; j < h; j++)
+				if (memcmp(px + (y + j) * pitch + x, rec_prev + (y + j) * rec_w + x, w * sizeof(Uint32)))
+					break;
+			if (j == h)
+				continue;
+			for (j = 0; j < h; j++)
+				memcpy(rec_prev + (y + j) * rec_w + x, px + (y + j) * pitch + x, w * sizeof(Uint32));
+			put16(buf + len, y / REC_TILE * ((rec_w + REC_TILE - 1) / REC_TILE) + x / REC_TILE);
+			j = rle_encode(px + y * pitch + x, pitch, w, h, buf + len + 4);
+			put16(buf + len + 2, j);
+			len += 4 + j;
+			n++;
+		}
+	put32(buf, len - 4);
+	put32(buf + 4, SDL_GetTicks() - rec_start);
+	put16(buf + 8, n);
+	return len;
+}
+
+// Open the -y or -w file or program, write the header and start the writer.
+// The recording is the size of the selected host's tile when it starts.
+void start_record()
+{
+	Uint8 hdr[16];
+	int i;
+
+	if (!rec_path)
+		return;
+	rec_w = sessions[focus].tile.w & (rec_tiles ? ~0 : ~1);
+	rec_h = sessions[focus].tile.h & (rec_tiles ? ~0 : ~1);
+	rec_size = 6 + rec_w * rec_h * 3 / 2;
+	if (rec_tiles)
+	{
+		i = ((rec_w + REC_TILE - 1) / REC_TILE) * ((rec_h + REC_TILE - 1) / REC_TILE);
+		rec_size = 10 + i * (4 + REC_TILE * REC_TILE * 3 + REC_TILE * REC_TILE / 128);
+		if (!(rec_prev = (Uint32*)SDL_calloc(rec_w * rec_h, sizeof(Uint32))))
+		{
+			printf("Out of memory\r\n");
+			exit(1);
+		}
+	}
+#ifdef _WIN32
+	rec_file = (rec_path[0] == '|') ? _popen(rec_path + 1, "wb") : fopen(rec_path, "wb");
+#else
+	rec_file = (rec_path[0] == '|') ? popen(rec_path + 1, "w") : fopen(rec_path, "wb");
+#endif
+	if (!rec_file)
+	{
+		perror(rec_path);
+		rec_path = NULL;
+		return;
+	}
+#if !defined (_WIN32)
+	if (rec_path[0] == '|')
+		signal(SIGPIPE, SIG_IGN);	// A program that quits ends the recording, not the viewer
+#endif
+	if (rec_tiles)
+	{
+		memcpy(hdr, "VC8R", 4);
+		put16(hdr + 4, REC_VERSION);
+		put16(hdr + 6, REC_TILE);
+		put16(hdr + 8, rec_w);
+		put16(hdr + 10, rec_h);
+		put32(hdr + 12, (Uint32)(frame_budget * 1000));
+		fwrite(hdr, 1, sizeof(hdr), rec_file);
+	}
+	else
+		fprintf(rec_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", rec_w, rec_h, (int)(1000 / frame_budget + 0.5));
+	fflush(rec_file);
+	for (i = 0; i < REC_FRAMES; i++)
+	{
+		if (!(rec_buf[i] = (Uint8*)SDL_malloc(rec_size)))
+		{
+			printf("Out of memory\r\n");
+			exit(1);
+		}
+		memcpy(rec_buf[i], "FRAME\n", 6);
+		rec_len[i] = rec_size;
+	}
+#if defined (__linux__)
+	struct stat st;
+	int sz;
+
+	// The pipe must hold fewer frames than the buffers that are kept back. -w
+	// frames are of any size, so they are always copied.
+	if (!rec_tiles && !fstat(fileno(rec_file), &st) && S_ISFIFO(st.st_mode))
+	{
+		fcntl(fileno(rec_file), F_SETPIPE_SZ, rec_size);
+		sz = fcntl(fileno(rec_file), F_GETPIPE_SZ);
+		rec_spare = (sz > 0) ? sz / rec_size + 2 : REC_FRAMES;	// + the frames at either end
+		rec_splice = (rec_spare <= REC_FRAMES - 2);
+		if (!rec_splice)
+			rec_spare = 0;
+	}
+#endif
+	rec_lock = SDL_CreateMutex();
+	rec_ready = SDL_CreateSemaphore(0);
+	rec_next = rec_start = SDL_GetTicks();
+	rec_thr = SDL_CreateThread(thr_record, "RecordThread", NULL);
+	printf("Recording %dx%d to %s%s%s\r\n", rec_w, rec_h, rec_path, rec_tiles ? " in squares" : "", rec_splice ? " with vmsplice" : "");
+}
+
+// Let the writer finish the frames already converted, then close the file.
+void stop_record()
+{
+	if (!rec_thr)
+		return;
+	rec_path = NULL;
+	SDL_SemPost(rec_ready);
+	SDL_WaitThread(rec_thr, NULL);
+	rec_thr = NULL;
+	if (rec_file && rec_file != stdout)
+	{
+#ifdef _WIN32
+		_pclose(rec_file);
+#else
+		if (pclose(rec_file) == -1)
+			fclose(rec_file);
+#endif
+	}
+}
+
+// Convert the selected host's tile into the next free buffer of the ring, if a
+// frame is due. If the writer is behind and none is free the frame is dropped.
+void record_frame(vc8_session* s)
+{
+	Uint8* buf;
+	Uint64 t;
+	double now = SDL_GetTicks();
+
+	if (now < rec_next)
+		return;
+	rec_next = (now - rec_next > frame_budget) ? now + frame_budget : rec_next + frame_budget;
+	if ((s->tile.w & (rec_tiles ? ~0 : ~1)) != rec_w || (s->tile.h & (rec_tiles ? ~0 : ~1)) != rec_h)
+	{
+		printf("Recording stopped: the tile changed size\r\n");
+		stop_record();
+		return;
+	}
+	SDL_LockMutex(rec_lock);
+	buf = (rec_head - rec_tail < REC_FRAMES - rec_spare) ? rec_buf[rec_head % REC_FRAMES] : NULL;
+	if (!buf)
+		rec_drops++;
+	SDL_UnlockMutex(rec_lock);
+	if (!buf)
+		return;
+	t = SDL_GetPerformanceCounter();
+	if (frame_sync)		// Whole frames only
+		SDL_LockMutex(s->lock);
+	if (rec_tiles)
+		rec_len[rec_head % REC_FRAMES] = encode_tiles(s, buf);
+	else
+		rgb_to_i420((Uint8*)s->surface->pixels, s->surface->pitch, rec_w, rec_h,
+			buf + 6, buf + 6 + rec_w * rec_h, buf + 6 + rec_w * rec_h * 5 / 4);
+	if (frame_sync)
+		SDL_UnlockMutex(s->lock);
+	rec_cost += SDL_GetPerformanceCounter() - t;
+	SDL_LockMutex(rec_lock);
+	rec_head++;
+	SDL_UnlockMutex(rec_lock);
+	SDL_SemPost(rec_ready);
+}
+
+#if defined (__linux__)
+// The name goes at exit, however the app ends (the last host closing calls exit()
+// from a receive thread). Readers that have it mapped keep the last frame.
+void unlink_export()
+{
+	char path[256] = "/";
+
+	strncat(path, export_name, sizeof(path) - 2);
+	shm_unlink(path);
+}
+
+// Make the -e shared memory object. The buffers are made big enough for a tile
+// the size of the desktop, as the window may be resized.
+void start_export()
+{
+	SDL_DisplayMode mode = { 0 };
+	char path[256] = "/";
+	long page = sysconf(_SC_PAGESIZE);
+	Uint32 hsize, bsize;
+	void* p;
+	int fd;
+
+	if (!export_name)
+		return;
+	SDL_GetDesktopDisplayMode(0, &mode);
+	hsize = (sizeof(vc8_shm_header) + page - 1) / page * page;
+	bsize = (SDL_max(mode.w, WINDOW_WIDTH) * SDL_max(mode.h, WINDOW_WIDTH) * sizeof(Uint32) + page - 1) / page * page;
+	shm_size = hsize + 2 * (size_t)bsize;
+	strncat(path, export_name, sizeof(path) - 2);
+	fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 && errno == EEXIST)		// Take it over only if the viewer that made it has gone
+	{
+		struct stat st;
+		vc8_shm_header* old;
+		Uint32 pid = 0;
+
+		if ((fd = shm_open(path, O_RDONLY, 0)) >= 0)
+		{
+			if (!fstat(fd, &st) && st.st_size >= (off_t)sizeof(*old)
+				&& (old = (vc8_shm_header*)mmap(NULL, sizeof(*old), PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED)
+			{
+				if (old->magic == VC8_SHM_MAGIC)
+					pid = old->pid;
+				munmap(old, sizeof(*old));
+			}
+			close(fd);
+		}
+		if (pid && (!kill(pid, 0) || errno == EPERM))
+		{
+			printf("%s is being exported by process %u, -e ignored\r\n", path, pid);
+			export_name = NULL;
+			return;
+		}
+		shm_unlink(path);
+		fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+	if (fd < 0 || ftruncate(fd, shm_size) || (p = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		perror(path);
+		if (fd >= 0)
+			close(fd);
+		export_name = NULL;
+		return;
+	}
+	close(fd);
+	atexit(unlink_export);
+	shm = (vc8_shm_header*)p;
+	memset(shm, 0, sizeof(*shm));
+	shm->header_size = hsize;
+	shm->buffer_size = bsize;
+	shm->version = VC8_SHM_VERSION;
+	shm->pid = getpid();
+	__sync_synchronize();
+	shm->magic = VC8_SHM_MAGIC;
+	printf("Exporting frames to %s, %u KB a buffer\r\n", path, bsize / 1024);
+}
+
+void stop_export()
+{
+	if (!shm)
+		return;
+	munmap(shm, shm_size);
+	shm = NULL;
+}
+
+// Copy the tile into the buffer the readers are not using and wake them. Never
+// waits: a reader still in that buffer sees its sequence count move and retries.
+void export_frame(vc8_session* s)
+{
+	Uint32 b = shm->current ^ 1;
+	Uint8* dst = (Uint8*)shm + shm->header_size + b * shm->buffer_size;
+	vc8_shm_frame* info = &shm->info[b];
+	Uint64 t = SDL_GetPerformanceCounter();
+	struct timespec ts;
+	int i, w, h;
+
+	w = s->tile.w;
+	h = SDL_min(s->tile.h, (int)(shm->buffer_size / (w * sizeof(Uint32))));
+	shm->seq[b]++;		// Odd: being written
+	__sync_synchronize();
+	if (frame_sync)		// Whole frames only
+		SDL_LockMutex(s->lock);
+	for (i = 0; i < h; i++)
+		memcpy(dst + i * w * sizeof(Uint32), (Uint8*)s->surface->pixels + i * s->surface->pitch, w * sizeof(Uint32));
+	if (frame_sync)
+		SDL_UnlockMutex(s->lock);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	info->width = w;
+	info->height = h;
+	info->stride = w * sizeof(Uint32);
+	info->format = VC8_SHM_XRGB8888;
+	info->frame = ++shm_frames;
+	info->time_us = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+	__sync_synchronize();
+	shm->seq[b]++;
+	shm->current = b;
+	__sync_synchronize();
+	shm->frame++;
+	syscall(SYS_futex, &shm->frame, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	shm_cost += SDL_GetPerformanceCounter() - t;
+}
+#else
+void start_export()
+{
+	if (export_name)
+		printf("-e is only supported on Linux\r\n");
+	export_name = NULL;
+}
+
+void stop_export()
+{
+}
+
+void export_frame(vc8_session* s)
+{
+}
+#endif
+
+// Worker pool for the per-frame passes over the persistence buffers (-t n).
+// Each pass is split into row bands, one per worker plus one done by the display
+// thread, and the frame waits for every band before going on (a barrier).
+// Small windows are faster on one thread, so the pool only runs above BAND_MIN_PIXELS.
+void do_bands(int band, int nbands)
+{
+	int i, h;
+
+	for (i = 0; i < nsessions; i++)
+	{
+		h = sessions[i].surface->h;
+		band_job(&sessions[i], h * band / nbands, h * (band + 1) / nbands);
+	}
+}
+
+int thr_band(void* arg)
+{
+	int k = (int)(intptr_t)arg;
+	char name[32];
+
+	snprintf(name, sizeof(name), "BandThread %d", k);
+	place_thread(name, band_cpus, k + 1);
+	while (1)
+	{
+		SDL_SemWait(band_go[k]);
+		if (!run_thr)
+			break;
+		do_bands(k + 1, nbanders + 1);		// Only woken when the whole pool is in use
+		SDL_SemPost(band_done);
+	}
+	return 0;
+}
+
+void start_bands()
+{
+	int i;
+
+	if (nbanders < 0)
+		nbanders = SDL_GetCPUCount() - 1;
+	if (nbanders > MAX_BANDERS)
+		nbanders = MAX_BANDERS;
+	if (disp_cpus && count_cpus(disp_cpus) > nbanders)	// Helpers sharing a cpu would be slower than none
+		band_cpus = disp_cpus;
+	band_done = SDL_CreateSemaphore(0);
+	for (i = 0; i < nbanders; i++)
+	{
+		band_go[i] = SDL_CreateSemaphore(0);
+		band_thr[i] = SDL_CreateThread(thr_band, "BandThread", (void*)(intptr_t)i);
+		if (!band_thr[i])
+		{
+			nbanders = i;
+			break;
+		}
+	}
+}
+
+void stop_bands()
+{
+	int i;
+
+	for (i = 0; i < nbanders; i++)
+	{
+		SDL_SemPost(band_go[i]);
+		SDL_WaitThread(band_thr[i], NULL);
+	}
+	nbanders = 0;
+}
+
+// Run fn over all the rows of every tile and return when it is finished.
+void run_bands(band_fn fn)
+{
+	int i, n = (tile_pixels < BAND_MIN_PIXELS) ? 0 : nbanders;
+
+	band_job = fn;
+	for (i = 0; i < n; i++)
+		SDL_SemPost(band_go[i]);
+	do_bands(0, n + 1);
+	for (i = 0; i < n; i++)
+		SDL_SemWait(band_done);
+}
+
+// Build the tables that take a 10 bit VC8 code straight to a pixel column and to
+// the offset of a pixel row, so plotting needs no division or modulo. The +512
+// rotation of the VC8 coordinates is folded in, and the spot is kept inside the tile.
+// With -A the tables address the intensity buffer instead, and with -T its blocks.
+void build_maps(vc8_session* s)
+{
+	int c, v, x, y;
+	int w = s->surface->w, h = s->surface->h;
+	int stride = retained ? 1 : s->surface->pitch / 4;		// -R: plain rows
+	int spot = 2;
+
+	for (c = 0; c < 1024; c++)		// -D pixels, at the -A resolution
+	{
+		v = (c + 512) % 1024;
+		s->col[c] = v * w * ssample / 1024;
+		s->row[c] = SDL_min((1024 - v) * h * ssample / 1024, h * ssample - 1) * w * ssample;
+	}
+
+	if (s->accum)
+	{
+		w = h = stride = s->surface->w * ssample;
+		spot = 2 * ssample;
+	}
+	if (beam)
+	{
+		for (c = 0; c < 1024; c++)
+		{
+			v = (c + 512) % 1024;
+			x = v * w * 4 / 1024;		// In quarter pixels
+			y = (1024 - v) * h * 4 / 1024;
+			s->xmap[c] = (SDL_max(0, SDL_min((x >> 2) - stamp_size / 2, w - stamp_size)) << 2) | (x & 3);
+			s->ymap[c] = ((SDL_max(0, SDL_min((y >> 2) - stamp_size / 2, h - stamp_size)) * stride) << 2) | (y & 3);
+		}
+		return;
+	}
+	if (tiled)
+	{
+		for (c = 0; c < 1024; c++)
+		{
+			v = (c + 512) % 1024;
+			x = SDL_min(v * w / 1024, w - spot);
+			y = SDL_min((1024 - v) * h / 1024, h - spot);
+			s->xmap[c] = (x >> 3) * 64 + (x & 7);
+			s->ymap[c] = (y >> 3) * ((w + 7) & ~7) * 8 + (y & 7) * 8;
+			s->xstep[c] = ((x & 7) == 7) ? 64 - 7 : 1;
+			s->ystep[c] = ((y & 7) == 7) ? ((w + 7) & ~7) * 8 - 7 * 8 : 8;
+		}
+		return;
+	}
+
+	for (c = 0; c < 1024; c++)
+	{
+		v = (c + 512) % 1024;
+		x = v * w / 1024;
+		y = (1024 - v) * h / 1024;
+		s->xmap[c] = (x < w - spot) ? x : w - spot;
+		s->ymap[c] = ((y < h - spot) ? y : h - spot) * stride;
+	}
+}
+
+// Load a texture from a buffer of RGB888 pixels in the way chosen at start up.
+void upload(SDL_Texture* tex, const void* pixels, int pitch, int w, int h)
+{
+	void* dst;
+	int i, dpitch;
+
+	if (!tex_lock)
+	{
+		SDL_UpdateTexture(tex, NULL, pixels, pitch);
+		return;
+	}
+	if (SDL_LockTexture(tex, NULL, &dst, &dpitch))
+		return;
+	for (i = 0; i < h; i++)
+		memcpy((Uint8*)dst + i * dpitch, (const Uint8*)pixels + i * pitch, w * sizeof(Uint32));
+	SDL_UnlockTexture(tex);
+}
+
+// What the choice of renderer depends on: the machine, the video driver, the
+// renderers SDL has and the display.
+void fingerprint(char* buf, int len)
+{
+	SDL_RendererInfo info;
+	SDL_DisplayMode mode = { 0 };
+	int i, n;
+
+	SDL_GetDesktopDisplayMode(0, &mode);
+	n = SDL_snprintf(buf, len, "%s/%s/%d cpus/%dx%d@%d/", SDL_GetPlatform(), SDL_GetCurrentVideoDriver(),
+		SDL_GetCPUCount(), mode.w, mode.h, mode.refresh_rate);
+	for (i = 0; i < SDL_GetNumRenderDrivers() && n < len; i++)
+		if (!SDL_GetRenderDriverInfo(i, &info))
+			n += SDL_snprintf(buf + n, len - n, "%s,", info.name);
+}
+
+// Time a frame of loading and drawing a size x size tile on renderer i, with
+// vsync off. Frames are drawn until ms is used up; the first is not counted.
+// Returns the mean frame time, or -1 if the renderer cannot be made.
+double tune_variant(int i, int lock, int size, double ms)
+{
+	SDL_Renderer* r;
+	SDL_Texture* tex;
+	Uint32* pixels;
+	Uint64 t0, t1, end;
+	double freq = (double)SDL_GetPerformanceFrequency();
+	int n = 0;
+
+	SDL_SetHint(SDL_HINT_RENDER_VSYNC, "0");
+	if (!(r = SDL_CreateRenderer(window, i, 0)))
+		return -1;
+	tex = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGB888, lock ? SDL_TEXTUREACCESS_STREAMING : SDL_TEXTUREACCESS_STATIC, size, size);
+	pixels = (Uint32*)SDL_calloc(size * size, sizeof(Uint32));
+	if (!tex || !pixels)
+	{
+		SDL_free(pixels);
+		SDL_DestroyRenderer(r);
+		return -1;
+	}
+	tex_lock = lock;
+	end = SDL_GetPerformanceCounter() + (Uint64)(ms * freq / 1000);
+	for (t0 = t1 = 0; n < 3 || SDL_GetPerformanceCounter() < end; n++)
+	{
+		if (n == 1)
+			t0 = SDL_GetPerformanceCounter();
+		pixels[n % (size * size)] = 0xf800;
+		upload(tex, pixels, size * sizeof(Uint32), size, size);
+		SDL_RenderClear(r);
+		SDL_RenderCopy(r, tex, NULL, NULL);
+		SDL_RenderPresent(r);
+		t1 = SDL_GetPerformanceCounter();
+	}
+	SDL_free(pixels);
+	SDL_DestroyTexture(tex);
+	SDL_DestroyRenderer(r);
+	return (t1 - t0) * 1000.0 / freq / (n - 1);
+}
+
+// Store the tuned renderer for this machine in the tune.txt cache, keeping the
+// lines of other machines and dropping any old line for this one. The file is
+// rewritten through a temporary copy so a crash cannot leave it half written.
+void save_tune(const char* file, const char* fp, const char* name, const char* how)
+{
+	char tmp[520], line[640], *tab;
+	FILE *f, *t;
+
+	SDL_snprintf(tmp, sizeof(tmp), "%s.new", file);
+	if (!(t = fopen(tmp, "w")))
+		return;
+	if ((f = fopen(file, "r")))
+	{
+		while (fgets(line, sizeof(line), f))
+			if (!(tab = strchr(line, '\t')) || strncmp(line, fp, tab - line) || fp[tab - line])
+				fputs(line, t);
+		fclose(f);
+	}
+	fprintf(t, "%s\t%s %s\n", fp, name, how);
+	if (fclose(t) || rename(tmp, file))
+	{
+		perror(file);
+		remove(tmp);
+	}
+}
+
+// Pick the renderer and the way of loading textures: forced by -X, from the
+// tune.txt cache, or by trying them all. Returns the renderer, made with vsync.
+SDL_Renderer* choose_renderer()
+{
+	SDL_RendererInfo info;
+	char fp[512], line[640], file[512] = "", name[32] = "", how[8] = "update", *path, *tab;
+	const char* from = "forced";
+	double ms, best = -1;
+	int i, w, h, n = SDL_GetNumRenderDrivers(), pick = -1;
+	FILE* f;
+
+	fingerprint(fp, sizeof(fp));
+	if ((path = SDL_GetPrefPath("VC8", "VC8_Remote")))
+		SDL_snprintf(file, sizeof(file), "%stune.txt", path);
+	SDL_free(path);
+	if (tune_force && strcmp(tune_force, "tune"))
+		sscanf(tune_force, "%31[^:]:%7s", name, how);
+	else if (!tune_force && file[0] && (f = fopen(file, "r")))
+	{
+		from = "cached";
+		while (fgets(line, sizeof(line), f))		// save_tune() keeps one line per machine
+			if ((tab = strchr(line, '\t')) && (*tab = 0, !strcmp(line, fp)))
+				sscanf(tab + 1, "%31s %7s", name, how);
+		fclose(f);
+	}
+	if (name[0])
+	{
+		for (i = 0; i < n; i++)
+			if (!SDL_GetRenderDriverInfo(i, &info) && !strcmp(info.name, name))
+				pick = i;
+		if (pick < 0)
+			printf("No renderer %s, trying them all\r\n", name);
+	}
+	if (pick < 0)
+	{
+		from = "tuned";
+		SDL_GetWindowSize(window, &w, &h);
+		for (i = 0; i < n; i++)
+			for (tex_lock = 0; tex_lock < 2; tex_lock++)
+			{
+				ms = tune_variant(i, tex_lock, SDL_min(w, h), (double)TUNE_MS / (2 * n));
+				if (ms >= 0 && (best < 0 || ms < best))
+				{
+					best = ms;
+					pick = i;
+					strcpy(how, tex_lock ? "lock" : "update");
+				}
+			}
+		if (pick >= 0 && !SDL_GetRenderDriverInfo(pick, &info) && file[0])
+			save_tune(file, fp, info.name, how);
+	}
+	tex_lock = !strcmp(how, "lock");
+	SDL_SetHint(SDL_HINT_RENDER_VSYNC, "1");
+	SDL_Renderer* r = SDL_CreateRenderer(window, pick, (pick < 0) ? SDL_RENDERER_ACCELERATED : 0);
+	if (r && !SDL_GetRendererInfo(r, &info))
+		printf("Renderer %s, textures loaded with %s (%s)\r\n", info.name, tex_lock ? "SDL_LockTexture" : "SDL_UpdateTexture", from);
+	return r;
+}
+
+// Play a -w recording (-p) in a window of its own, each frame at the time it
+// was recorded. ESC or closing the window stops it.
+int play_recording()
+{
+	SDL_Event event;
+	SDL_Texture* tex;
+	FILE* f;
+	Uint8 hdr[16], *buf;
+	Uint32* px;
+	Uint32 start, len;
+	Uint64 t, cost = 0;
+	double freq = (double)SDL_GetPerformanceFrequency();
+	int w, h, cols, n, i, idx, x, y, size, frames = 0, ms = 0, run = 1;
+
+	if (!(f = fopen(play_path, "rb")))
+	{
+		perror(play_path);
+		return EXIT_FAILURE;
+	}
+	if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || memcmp(hdr, "VC8R", 4) || get16(hdr + 4) != REC_VERSION
+		|| get16(hdr + 6) != REC_TILE || !(w = get16(hdr + 8)) || !(h = get16(hdr + 10)))
+	{
+		printf("%s: not a VC8 recording\r\n", play_path);
+		fclose(f);
+		return EXIT_FAILURE;
+	}
+	cols = (w + REC_TILE - 1) / REC_TILE;
+	px = (Uint32*)SDL_calloc(w * h, sizeof(Uint32));
+	buf = (Uint8*)SDL_malloc(10 + cols * ((h + REC_TILE - 1) / REC_TILE) * (4 + REC_TILE * REC_TILE * 3 + REC_TILE * REC_TILE / 128));
+	if (!px || !buf)
+	{
+		printf("Out of memory\r\n");
+		exit(1);
+	}
+	SDL_Init(SDL_INIT_VIDEO);
+	window = SDL_CreateWindow("VC8 Playback", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, win_w ? win_w : w, win_h ? win_h : h,
+		SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | (fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0));
+	if (!window || !(rend = choose_renderer())
+		|| !(tex = SDL_CreateTexture(rend, SDL_PIXELFORMAT_RGB888, tex_lock ? SDL_TEXTUREACCESS_STREAMING : SDL_TEXTUREACCESS_STATIC, w, h)))
+	{
+		printf("%s\r\n", SDL_GetError());
+		exit(1);
+	}
+	printf("Playing %dx%d from %s\r\n", w, h, play_path);
+	start = SDL_GetTicks();
+	while (run && fread(hdr, 1, 4, f) == 4)
+	{
+		len = get32(hdr);
+		if (len < 6 || len > 6 + (Uint32)cols * ((h + REC_TILE - 1) / REC_TILE) * (4 + REC_TILE * REC_TILE * 3 + REC_TILE * REC_TILE / 128)
+			|| fread(buf, 1, len, f) != len)
+			break;
+		ms = get32(buf);
+		n = get16(buf + 4);
+		t = SDL_GetPerformanceCounter();
+		for (i = 6; n > 0 && i + 4 <= (int)len; n--, i += 4 + size)
+		{
+			idx = get16(buf + i);
+			size = get16(buf + i + 2);
+			x = idx % cols * REC_TILE;
+			y = idx / cols * REC_TILE;
+			if (y >= h || i + 4 + size > (int)len
+				|| !rle_decode(buf + i + 4, size, px + y * w + x, w, SDL_min(REC_TILE, w - x), SDL_min(REC_TILE, h - y)))
+				break;
+		}
+		cost += SDL_GetPerformanceCounter() - t;
+		if (n)
+		{
+			printf("%s: bad frame at %d ms\r\n", play_path, ms);
+			break;
+		}
+		frames++;
+		while (run && SDL_GetTicks() - start < (Uint32)ms)
+		{
+			while (SDL_PollEvent(&event))
+				if (event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE))
+					run = 0;
+			SDL_Delay(SDL_min(ms - (SDL_GetTicks() - start), 5));
+		}
+		upload(tex, px, w * sizeof(Uint32), w, h);
+		SDL_SetRenderDrawColor(rend, 0, 0, 0, 0xff);
+		SDL_RenderClear(rend);
+		SDL_RenderCopy(rend, tex, NULL, NULL);
+		SDL_RenderPresent(rend);
+	}
+	fclose(f);
+	SDL_free(px);
+	SDL_free(buf);
+	if (frames)
+		printf("Played %d frames, %.1f s; decoding took %.3f ms a frame, %.0f times real time\r\n", frames, ms / 1000.0,
+			cost * 1000.0 / freq / frames, ms * freq / 1000.0 / SDL_max(cost, 1));
+	SDL_DestroyTexture(tex);
+	SDL_DestroyRenderer(rend);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	return EXIT_SUCCESS;
+}
+
+// (Re)create the -G buffers and texture for a tile. The texture is scaled up with
+// linear filtering. They are made even when -G is off so F9 can turn it on.
+int make_bloom(vc8_session* s)
+{
+	int sw = s->tile.w / 4, sh = s->tile.h / 4;
+
+	SDL_free(s->bloom);
+	SDL_free(s->bloom_px);
+	if (s->bloom_tex)
+		SDL_DestroyTexture(s->bloom_tex);
+	s->bloom = (Uint32*)SDL_calloc(sw * (sh + 4), sizeof(Uint32));
+	s->bloom_px = (Uint32*)SDL_calloc(sw * sh, sizeof(Uint32));
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+	s->bloom_tex = SDL_CreateTexture(rend, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, sw, sh);
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+	if (!s->bloom || !s->bloom_px || !s->bloom_tex)
+		return 0;
+	SDL_SetTextureBlendMode(s->bloom_tex, SDL_BLENDMODE_ADD);
+	return 1;
+}
+
+// Lay the hosts out as a near-square grid of square tiles that fits the window,
+// and (re)create each persistence buffer whose size has changed.
+int layout_tiles()
+{
+	int i, w, h, cols, rows, size, x0, y0;
+	vc8_session* s;
+	SDL_Surface* surface;
+	SDL_Texture* tex;
+	Uint8* accum = NULL;
+	Uint8* glow = NULL;
+	Uint32* seen = NULL;
+
+	SDL_GetWindowSize(window, &w, &h);
+	for (cols = 1; cols * cols < nsessions; cols++)
+		;
+	rows = (nsessions + cols - 1) / cols;
+	size = (w / cols < h / rows) ? w / cols : h / rows;
+	if (size < 16)
+		size = 16;
+	x0 = (w - size * cols) / 2;
+	y0 = (h - size * rows) / 2;
+	tile_pixels = 0;
+	for (i = 0; i < nsessions; i++)
+	{
+		s = &sessions[i];
+		s->tile.x = x0 + (i % cols) * size;
+		s->tile.y = y0 + (i / cols) * size;
+		s->tile.w = size;
+		s->tile.h = size;
+		tile_pixels += size * size * ssample * ssample;
+		if (s->surface && s->surface->w == size)
+			continue;
+		surface = SDL_CreateRGBSurface(0, size, size, 32, 0, 0, 0, 0);
+		tex = surface ? SDL_CreateTexture(rend, SDL_PIXELFORMAT_RGB888,
+			tex_lock ? SDL_TEXTUREACCESS_STREAMING : SDL_TEXTUREACCESS_STATIC, size, size) : NULL;
+		if (tiled)
+			accum = (Uint8*)SDL_calloc(((size + 7) & ~7) * ((size + 7) & ~7), 1);
+		else if (use_accum)
+			accum = (Uint8*)SDL_calloc(size * ssample * size * ssample + STAMP_PITCH, 1);
+		if (p7)
+			glow = (Uint8*)SDL_calloc(size * ssample * size * ssample, 1);
+		if (dedup)
+		{
+			seen = (Uint32*)SDL_calloc((size * ssample * size * ssample + 31) / 32, sizeof(Uint32));
+			if (!s->dirty)
+				s->dirty = (Uint32*)SDL_malloc(DEDUP_DIRTY * sizeof(Uint32));
+		}
+		if (!tex || (use_accum && !accum) || (p7 && !glow) || (dedup && (!seen || !s->dirty)))
+			return 0;
+		SDL_LockMutex(s->lock);		// The receive thread may be plotting
+		SDL_Surface* old = s->surface;
+		Uint8* old_accum = s->accum;
+		Uint8* old_glow = s->glow;
+		Uint32* old_seen = s->seen;
+		s->surface = surface;
+		s->accum = accum;
+		s->glow = glow;
+		s->seen = seen;
+		s->ndirty = 0;
+		build_maps(s);
+		SDL_UnlockMutex(s->lock);
+		if (old)
+			SDL_FreeSurface(old);
+		SDL_free(old_accum);
+		SDL_free(old_glow);
+		SDL_free(old_seen);
+		if (!make_bloom(s))
+			return 0;
+		if (s->tex)
+			SDL_DestroyTexture(s->tex);
+		s->tex = tex;
+	}
+	return 1;
+}
+
+int main_loop()
+{
+	SDL_Event event;
+	SDL_Point pt;
+	vc8_session* s;
+	Uint64 pass, glow, t;
+	Uint32 last_pass = SDL_GetTicks();
+	SDL_DisplayMode mode;
+	SDL_Rect r;
+	int i;
+
+	SDL_Init(SDL_INIT_VIDEO);
+	place_thread("DisplayThread", disp_cpus, -1);
+	for (i = 1; i * i < nsessions; i++)
+		;
+	if (!win_w || !win_h)
+	{
+		win_w = WINDOW_WIDTH * winsize * i;
+		win_h = WINDOW_WIDTH * winsize * ((nsessions + i - 1) / i);
+	}
+	window = SDL_CreateWindow("VC8 Display", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, win_w, win_h,
+		SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | (fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0));
+	if (!window)
+		printf("%s\r\n", SDL_GetError());
+
+	rend = SDL_GetRenderer(window);
+	if (rend)
+		SDL_DestroyRenderer(rend);
+	rend = choose_renderer();
+	if (!rend)
+		printf("%s\r\n", SDL_GetError());
+	if (!rend || !window)
+		exit(1);
+	if (!layout_tiles())
+	{
+		printf("%s\r\n", SDL_GetError());
+		exit(1);
+	}
+	set_focus(0);
+	start_bands();
+	start_capture();
+	lock_memory();
+	if (!SDL_GetWindowDisplayMode(window, &mode) && mode.refresh_rate)
+		frame_budget = 1000.0 / mode.refresh_rate;
+	start_record();
+	start_export();
+
+	sched.period = frame_budget;
+
+	while (1)
+	{
+		if (late_latch)
+			sched_wait();
+		frame_ms = SDL_min(SDL_GetTicks() - last_pass, P7_MAX_MS);
+		last_pass = SDL_GetTicks();
+		pass = SDL_GetPerformanceCounter();
+		if (frame_sync)		// With -A, -B, -P and -T the pass copies what commit_frame() plots
+			for (i = 0; i < nsessions; i++)
+				SDL_LockMutex(sessions[i].lock);
+		if (!retained)
+			run_bands(p7 ? fade_p7 : tiled ? fade_tiled : use_accum ? fade_ss : fade);
+		if (frame_sync)
+			for (i = 0; i < nsessions; i++)
+				SDL_UnlockMutex(sessions[i].lock);
+		pass = SDL_GetPerformanceCounter() - pass;
+		if (dedup)
+			for (i = 0; i < nsessions; i++)
+				dedup_clear(&sessions[i]);
+		glow = 0;
+		if (bloom)
+		{
+			glow = SDL_GetPerformanceCounter();
+			run_bands(bloom_h);
+			run_bands(bloom_v);
+			glow = SDL_GetPerformanceCounter() - glow;
+		}
+		SDL_SetRenderDrawColor(rend, 0, 0, 0, 0xff);
+		SDL_RenderClear(rend);
+		for (i = 0; i < nsessions; i++)
+		{
+			s = &sessions[i];
+			if (jitter_ms >= 0)
+				jitter_release(s, frame_ms);
+			if (frame_sync)		// Show the last frame once the points stop
+			{
+				SDL_LockMutex(s->lock);
+				if (s->npend && SDL_GetTicks() - s->last_point >= ((s->at_star && s->by_star) ? FRAME_HOLD_MS : FRAME_GAP_MS))
+					commit_frame(s, !(s->at_star && s->by_star));
+				SDL_UnlockMutex(s->lock);
+			}
+			if (retained)
+			{
+				t = SDL_GetPerformanceCounter();
+				draw_ring(s);
+				pass += SDL_GetPerformanceCounter() - t;
+				continue;
+			}
+			if (frame_sync)		// Only whole frames are ever in the surface
+				SDL_LockMutex(s->lock);
+			upload(s->tex, s->surface->pixels, s->surface->pitch, s->tile.w, s->tile.h);
+			if (frame_sync)
+				SDL_UnlockMutex(s->lock);
+			SDL_RenderCopy(rend, s->tex, NULL, &s->tile);
+			if (bloom)
+			{
+				SDL_UpdateTexture(s->bloom_tex, NULL, s->bloom_px, s->tile.w / 4 * sizeof(Uint32));
+				r = s->tile;
+				r.w = r.w / 4 * 4;
+				r.h = r.h / 4 * 4;
+				SDL_RenderCopy(rend, s->bloom_tex, NULL, &r);
+			}
+		}
+		if (nsessions > 1)
+		{
+			SDL_SetRenderDrawColor(rend, 0x40, 0x40, 0x40, 0xff);
+			SDL_RenderDrawRect(rend, &sessions[focus].tile);
+		}
+		t = SDL_GetPerformanceCounter();
+		SDL_RenderPresent(rend);
+		if (late_latch)
+			sched_presented(t);
+		cap_frame++;
+		if (capture_every && cap_frame % capture_every == 0)
+			capture_frame(&sessions[focus]);
+		if (rec_path)
+			record_frame(&sessions[focus]);
+		if (export_name)
+			export_frame(&sessions[focus]);
+		frame_stats(pass, glow);
+		if (!late_latch)
+			SDL_Delay(2);
+		if (SDL_PollEvent(&event))
+			switch (event.type)
+			{
+			case SDL_KEYDOWN:
+				if (event.key.keysym.sym == SDLK_F9)
+				{
+					if (!event.key.repeat && !retained)
+						bloom = !bloom;
+					break;
+				}
+				if (event.key.keysym.sym == SDLK_F12)
+				{
+					if (event.key.repeat)
+						break;
+					if (retained)
+						printf("-R does not draw the tile, nothing to save\r\n");
+					else
+						capture_frame(&sessions[focus]);
+					break;
+				}
+				if (event.key.keysym.sym == SDLK_F11)
+				{
+					if (!event.key.repeat)
+					{
+						fullscreen = !fullscreen;
+						SDL_SetWindowFullscreen(window, fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0);
+					}
+					break;
+				}
+				if (event.key.keysym.sym == SDLK_TAB)
+				{
+					if (!event.key.repeat)
+						set_focus((focus + 1) % nsessions);
+					break;
+				}
+				keyPressed(&sessions[focus], event.key.keysym.sym);
+				if (!event.key.repeat)
+					sendSR(&sessions[focus]);
+				break;
+			case SDL_KEYUP:
+				keyReleased(&sessions[focus], event.key.keysym.sym);
+				sendSR(&sessions[focus]);
+				break;
+			case SDL_MOUSEBUTTONDOWN:
+				pt.x = event.button.x;
+				pt.y = event.button.y;
+				for (i = 0; i < nsessions; i++)
+					if (SDL_EnclosePoints(&pt, 1, &sessions[i].tile, NULL))
+						set_focus(i);
+				break;
+
+			case SDL_WINDOWEVENT:
+				if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED && !layout_tiles())
+				{
+					printf("%s\r\n", SDL_GetError());
+					return -1;
+				}
+				break;
+			case SDL_QUIT:
+				return -1;
+			}
+	}
+	return 0;
+}
+
+
+// Open the connection to one PiDP8I: a host name (port portno), tcp:host:port,
+// or unix:/path and unix:@name for a Unix domain socket. They all end up as a
+// stream socket read by thr_recv() and written by sendSR().
+int connect_host(vc8_session* s, int portno)
+{
+	struct sockaddr_in serv_addr;
+	struct hostent* server;
+	char name[256], *colon;
+
+	strncpy(name, s->host, sizeof(name) - 1);
+	name[sizeof(name) - 1] = 0;
+	if (!strncmp(s->host, "unix:", 5))
+	{
+#if !defined (_WIN32)
+		struct sockaddr_un un;
+		socklen_t len;
+
+		memset(&un, 0, sizeof(un));
+		un.sun_family = AF_UNIX;
+		strncpy(un.sun_path, s->host + 5, sizeof(un.sun_path) - 1);
+		len = offsetof(struct sockaddr_un, sun_path) + strlen(un.sun_path);
+		if (un.sun_path[0] == '@')	// Abstract name: a leading 0 and no terminator
+			un.sun_path[0] = 0;
+		else
+			len++;
+		s->sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s->sockfd < 0)
+		{
+			perror("ERROR opening socket");
+			return 0;
+		}
+		if (connect(s->sockfd, (struct sockaddr*)&un, len) < 0)
+		{
+			fprintf(stderr, "%s: ", s->host);
+			perror("ERROR connecting");
+			return 0;
+		}
+		s->connected = 1;
+		return 1;
+#else
+		printf("%s: Unix domain sockets are not supported on Windows\r\n", s->host);
+		return 0;
+#endif
+	}
+	if (!strncmp(s->host, "tcp:", 4))
+	{
+		memmove(name, name + 4, strlen(name + 4) + 1);
+		if ((colon = strrchr(name, ':')))
+		{
+			*colon = 0;
+			portno = atoi(colon + 1);
+		}
+	}
+	s->sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s->sockfd < 0)
+	{
+		perror("ERROR opening socket");
+		return 0;
+	}
+	server = gethostbyname(name);
+	if (server == NULL)
+	{
+		fprintf(stderr, "%s: ", s->host);
+		perror("ERROR no such host");
+		return 0;
+	}
+	memset((void*)&serv_addr, '\0', sizeof(serv_addr));
+	serv_addr.sin_family = AF_INET;
+	memcpy((void*)&serv_addr.sin_addr.s_addr, (void*)server->h_addr, server->h_length);
+	serv_addr.sin_port = htons(portno);
+	if (connect(s->sockfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0)
+	{
+		fprintf(stderr, "%s: ", s->host);
+		perror("ERROR connecting");
+		return 0;
+	}
+	s->connected = 1;
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+
+	int portno = 2222;
+	int i, live;
+	SDL_Thread* sthrd[MAX_WORKERS];
+	SDL_Thread* serthrd[MAX_HOSTS] = { NULL };
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-L"))
+			winsize = 2;
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			nworkers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			recv_cpus = argv[++i];
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			disp_cpus = argv[++i];
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			parse_sched(argv[++i]);
+		else if (!strcmp(argv[i], "-m"))
+			lock_mem = 1;
+		else if (!strcmp(argv[i], "-S"))
+			show_stats = 1;
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			nbanders = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+			sscanf(argv[++i], "%dx%d", &win_w, &win_h);
+		else if (!strcmp(argv[i], "-F"))
+			fullscreen = 1;
+		else if (!strcmp(argv[i], "-A") && i + 1 < argc)
+			ssample = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-B"))
+			beam = 1;
+		else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+			hit = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-P"))
+			p7 = 1;
+		else if (!strcmp(argv[i], "-G"))
+			bloom = 1;
+		else if (!strcmp(argv[i], "-T"))
+			tiled = 1;
+		else if (!strcmp(argv[i], "-R"))
+			retained = 1;
+		else if (!strcmp(argv[i], "-f"))
+			frame_sync = 1;
+		else if (!strcmp(argv[i], "-l"))
+			late_latch = 1;
+		else if (!strcmp(argv[i], "-J") && i + 1 < argc)
+			jitter_ms = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-D"))
+			dedup = 1;
+		else if (!strcmp(argv[i], "-X") && i + 1 < argc)
+			tune_force = argv[++i];
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			capture_every = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-y") && i + 1 < argc)
+		{
+			rec_path = argv[++i];
+			rec_tiles = 0;
+		}
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+		{
+			rec_path = argv[++i];
+			rec_tiles = 1;
+		}
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			play_path = argv[++i];
+		else if (!strcmp(argv[i], "-e") && i + 1 < argc)
+			export_name = argv[++i];
+		else if (!strcmp(argv[i], "-U"))
+			use_uring = 1;
+		else if (argv[i][0] != '-' && nsessions < MAX_HOSTS)
+			strncpy(sessions[nsessions++].host, argv[i], sizeof(sessions[0].host) - 1);
+		else
+		{
+			nsessions = 0;		// Force the usage message
+			break;
+		}
+	}
+	if (play_path && nsessions == 0)
+		return play_recording();
+	if (nsessions == 0)
+	{
+		printf("Usage: vc8_remote <host|tcp:host:port|unix:path|unix:@name|udp:relay[:port]|/dev/tty[@baud]|shm:name> [<host> ...] <-L> <-j n> <-r cpus> <-d cpus> <-s fifo|rr|nice[:n]> <-m> <-S> <-t n> <-g WxH> <-F> <-A n> <-B> <-a n> <-P> <-G> <-T> <-R> <-f> <-l> <-J ms> <-D> <-X renderer[:update|lock]|tune> <-c n> <-y file|\"|command\"> <-w file> <-e name> <-U>\r\n"
+			"       vc8_remote -p file <-g WxH> <-F> <-X renderer[:update|lock]|tune>\r\n");
+		exit(1);
+	}
+	if (nworkers < 1)
+		nworkers = 1;
+	if (nworkers > MAX_WORKERS)
+		nworkers = MAX_WORKERS;
+	if (nworkers > nsessions)
+		nworkers = nsessions;
+	if (ssample < 1 || ssample > 4)
+		ssample = 1;
+	hit = SDL_max(0, SDL_min(255, hit));
+	if (jitter_ms < -1)
+		jitter_ms = 0;
+	if (capture_every < 0)
+		capture_every = 0;
+	if (tiled && (ssample > 1 || beam || p7))
+	{
+		printf("-T is only used with the square spot, ignored\r\n");
+		tiled = 0;
+	}
+	if (retained && (ssample > 1 || beam || p7 || tiled || hit || bloom))
+	{
+		printf("-R draws the plain square spot, -A -B -P -T -a and -G are ignored\r\n");
+		ssample = 1;
+		beam = p7 = tiled = hit = bloom = 0;
+	}
+	if (retained && capture_every)
+	{
+		printf("-R does not draw the tile, -c is ignored\r\n");
+		capture_every = 0;
+	}
+	if (retained && rec_path && !rec_tiles)
+	{
+		printf("-R does not draw the tile, -y is ignored\r\n");
+		rec_path = NULL;
+	}
+	if (retained && rec_path && rec_tiles)
+	{
+		printf("-R does not draw the tile, -w is ignored\r\n");
+		rec_path = NULL;
+	}
+	if (retained && export_name)
+	{
+		printf("-R does not draw the tile, -e is ignored\r\n");
+		export_name = NULL;
+	}
+	if (dedup && !(ssample > 1 || beam || p7 || hit))
+	{
+		printf("-D only pays with -A -B -P or -a, ignored\r\n");
+		dedup = 0;
+	}
+	use_accum = (ssample > 1 || beam || p7 || tiled);
+	init_stamps();
+	init_phosphor();
+	for (i = 0; i < nsessions; i++)
+	{
+		sessions[i].lock = SDL_CreateMutex();
+		if (retained)
+		{
+			sessions[i].ring = (Uint32*)SDL_calloc(RING_SIZE, sizeof(Uint32));
+			sessions[i].ring_t = (Uint32*)SDL_calloc(RING_SIZE, sizeof(Uint32));
+			if (!sessions[i].ring || !sessions[i].ring_t)
+			{
+				printf("Out of memory\r\n");
+				exit(1);
+			}
+		}
+		if (frame_sync && !(sessions[i].pend = (Uint32*)SDL_calloc(FRAME_MAX, sizeof(Uint32))))
+		{
+			printf("Out of memory\r\n");
+			exit(1);
+		}
+		if (jitter_ms >= 0)
+		{
+			sessions[i].jb = (Uint32*)SDL_calloc(JB_SIZE, sizeof(Uint32));
+			sessions[i].jb_t = (Uint32*)SDL_calloc(JB_SIZE, sizeof(Uint32));
+			if (!sessions[i].jb || !sessions[i].jb_t)
+			{
+				printf("Out of memory\r\n");
+				exit(1);
+			}
+		}
+	}
+
+	changemode(1);	// used for kbhit()
+	SDL_Init(SDL_INIT_VIDEO);
+
+#if defined (USE_SERIAL) && defined (_WIN32)	// On Linux a /dev/tty host does this
+
+	nsessions = 1;
+	nworkers = 1;
+	sessions[0].connected = 1;
+	sthrd[0] = SDL_CreateThread(thr_serial, "ReceiveThread", NULL);
+
+#else
+
+#ifdef _WIN32
+	static WSADATA winsockdata;
+	WSAStartup(MAKEWORD(1, 1), &winsockdata);
+#endif
+
+	for (i = 0; i < nsessions; i++)
+#if defined (__linux__)
+		if (!strncmp(sessions[i].host, "shm:", 4) ? !open_ring(&sessions[i]) :
+			!strncmp(sessions[i].host, "udp:", 4) ? !open_udp(&sessions[i], portno) :
+			sessions[i].host[0] == '/' ? !open_serial(&sessions[i]) : !connect_host(&sessions[i], portno))
+#else
+		if (!connect_host(&sessions[i], portno))
+#endif
+		{
+			changemode(0);
+			exit(1);
+		}
+
+	for (i = 0; i < nworkers; i++)
+		if (!(sthrd[i] = SDL_CreateThread(thr_recv, "ReceiveThread", (void*)(intptr_t)i)))
+		{
+			changemode(0);
+			printf("%s\r\n", SDL_GetError());
+			exit(1);
+		}
+#if defined (__linux__)
+	for (i = 0; i < nsessions; i++)
+		if ((sessions[i].serial || sessions[i].shm_ring || sessions[i].udp) && !(serthrd[i] = SDL_CreateThread(
+			sessions[i].serial ? thr_serial : sessions[i].udp ? thr_udp : thr_ring,
+			sessions[i].serial ? "SerialThread" : sessions[i].udp ? "UdpThread" : "RingThread", &sessions[i])))
+		{
+			changemode(0);
+			printf("%s\r\n", SDL_GetError());
+			exit(1);
+		}
+#endif
+
+#endif
+	main_loop();
+
+	run_thr = 0;	// Cause thread to exit;
+	stop_bands();
+	stop_capture();
+	stop_record();
+	stop_export();
+	changemode(0);	// used for kbhit()
+	for (i = 0; i < nworkers; i++)
+		SDL_WaitThread(sthrd[i], NULL);
+	for (i = 0; i < nsessions; i++)
+		if (serthrd[i])
+			SDL_WaitThread(serthrd[i], NULL);
+	for (i = 0, live = 0; i < nsessions; i++)
+		live += sessions[i].connected;
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	return live ? EXIT_SUCCESS : EXIT_FAILURE;	// Failure if every host went away
 }
 
-short keyPressed(char key)
+short keyPressed(vc8_session* s, char key)
 {
 	//  old_sr = sr;
 	switch (key)
 	{
 	case '1':
-		sr |= 0x800;
+		s->sr |= 0x800;
 		break;
 	case '2':
-		sr |= 0x400;
+		s->sr |= 0x400;
 		break;
 	case '3':
-		sr |= 0x200;
+		s->sr |= 0x200;
 		break;
 	case '4':
-		sr |= 0x100;
+		s->sr |= 0x100;
 		break;
 	case '5':
-		sr |= 0x80;
+		s->sr |= 0x80;
 		break;
 	case '6':
-		sr |= 0x40;
+		s->sr |= 0x40;
 		break;
 	case '7':
-		sr |= 0x20;
+		s->sr |= 0x20;
 		break;
 	case '8':
-		sr |= 0x10;
+		s->sr |= 0x10;
 		break;
 	case '9':
-		sr |= 0x8;
+		s->sr |= 0x8;
 		break;
 	case '0':
-		sr |= 0x4;
+		s->sr |= 0x4;
 		break;
 	case '-':
-		sr |= 0x2;
+		s->sr |= 0x2;
 		break;
 	case '=':
-		sr |= 0x1;
+		s->sr |= 0x1;
 		break;
 	case 'w':
-		sr |= 0x600;
+		s->sr |= 0x600;
 		break;
 	case 'p':
-		sr |= 0x6;
+		s->sr |= 0x6;
 		break;
 	default:
 		break;
@@ -509,55 +4069,55 @@ short keyPressed(char key)
 		s.write((sr & 0xF) | ((sr & 0xF00) >> 4));
 	  }
 	*/
-	return sr;
+	return s->sr;
 }
 
-short keyReleased(char key)
+short keyReleased(vc8_session* s, char key)
 {
 	//  old_sr = sr;
 	switch (key)
 	{
 	case '1':
-		sr &= ~0x800;
+		s->sr &= ~0x800;
 		break;
 	case '2':
-		sr &= ~0x400;
+		s->sr &= ~0x400;
 		break;
 	case '3':
-		sr &= ~0x200;
+		s->sr &= ~0x200;
 		break;
 	case '4':
-		sr &= ~0x100;
+		s->sr &= ~0x100;
 		break;
 	case '5':
-		sr &= ~0x80;
+		s->sr &= ~0x80;
 		break;
 	case '6':
-		sr &= ~0x40;
+		s->sr &= ~0x40;
 		break;
 	case '7':
-		sr &= ~0x20;
+		s->sr &= ~0x20;
 		break;
 	case '8':
-		sr &= ~0x10;
+		s->sr &= ~0x10;
 		break;
 	case '9':
-		sr &= ~0x8;
+		s->sr &= ~0x8;
 		break;
 	case '0':
-		sr &= ~0x4;
+		s->sr &= ~0x4;
 		break;
 	case '-':
-		sr &= ~0x2;
+		s->sr &= ~0x2;
 		break;
 	case '=':
-		sr &= ~0x1;
+		s->sr &= ~0x1;
 		break;
 	case 'w':
-		sr &= ~0x600;
+		s->sr &= ~0x600;
 		break;
 	case 'p':
-		sr &= ~0x6;
+		s->sr &= ~0x6;
 		break;
 	default:
 		break;
@@ -567,7 +4127,7 @@ short keyReleased(char key)
 		s.write((sr & 0xF) | ((sr & 0xF00) >> 4));
 	  }
 	*/
-	return sr;
+	return s->sr;
 }
 
 #ifdef _WIN32
@@ -0,0 +1,170 @@
+/* vc8_ring.h
+
+Part of VC8_Remote, under the same licence as vc8_remote.cpp.
+
+*/
+
+/*
+	A local transport for a simulator on the same machine as vc8_remote (Linux
+	only): the points go through a ring in shared memory instead of the loopback
+	TCP connection on port 2222. This file is all a producer needs.
+	*
+	* The simulator makes the ring with vc8_ring_create("pidp8i", 0) and hands each
+	* VC8 point to vc8_ring_put(r, x, y), with the 10 bit x and y codes it would
+	* have sent over TCP. The viewer is started with the host shm:pidp8i.
+	* vc8_ring_sr(r) is the switch register as set by the viewer's keys (12 bits).
+	* vc8_ring_close() tells the viewer the simulator has gone.
+	*
+	* There is one producer and one reader. The producer never waits: if the
+	* viewer has fallen VC8_RING_POINTS behind, vc8_ring_put() drops the point and
+	* returns 0. The viewer takes the points in batches and sleeps (on a futex on
+	* head) when the ring is empty; then, and only then, the producer wakes it.
+	* The viewer watches an empty ring for a fraction of a millisecond before it
+	* sleeps, so while points keep coming neither side makes a system call for them.
+	*
+	* Build with: gcc ... -lrt
+*/
+
+#ifndef VC8_RING_H
+#define VC8_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define VC8_RING_MAGIC 0x50384356		// "VC8P"
+#define VC8_RING_VERSION 1
+#define VC8_RING_POINTS 65536			// Default size, a power of 2
+
+struct vc8_ring {
+	uint32_t magic;				// VC8_RING_MAGIC
+	uint32_t version;			// VC8_RING_VERSION
+	uint32_t size;				// Points in the ring, a power of 2
+	uint32_t pid;				// The producer, so the viewer can tell if it dies
+	uint32_t pad0[12];
+	volatile uint32_t head;		// Points put; written by the producer only
+	volatile uint32_t closed;	// The producer has finished
+	uint32_t dropped;			// Points the producer could not put
+	uint32_t pad1[13];
+	volatile uint32_t tail;		// Points taken; written by the viewer only
+	volatile uint32_t waiting;	// The viewer is (about to be) asleep on head
+	volatile uint32_t sr;		// Switch register, from the viewer
+	uint32_t pad2[13];
+	uint32_t points[];			// x | y << 16, 10 bits each
+};
+
+static inline void vc8_ring_wake(struct vc8_ring* r);
+
+// Make the ring called name with size points (0 = VC8_RING_POINTS). A ring left
+// by a producer that has gone is taken over: it is marked closed, so a viewer
+// still reading it lets go, and a new one is made in its place, so that viewer's
+// mapping keeps the old pages. Returns NULL with errno EBUSY if the producer of
+// the existing ring is still running.
+static inline struct vc8_ring* vc8_ring_create(const char* name, uint32_t size)
+{
+	char path[256] = "/";
+	struct vc8_ring* r;
+	struct stat st;
+	size_t bytes;
+	void* p;
+	int fd;
+
+	if (!size)
+		size = VC8_RING_POINTS;
+	if (size & (size - 1))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	bytes = sizeof(*r) + size * sizeof(uint32_t);
+	strncat(path, name, sizeof(path) - 2);
+	if ((fd = shm_open(path, O_RDWR, 0)) >= 0)		// One there already
+	{
+		if (!fstat(fd, &st) && st.st_size >= (off_t)sizeof(*r)
+			&& (p = mmap(NULL, sizeof(*r), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != MAP_FAILED)
+		{
+			r = (struct vc8_ring*)p;
+			if (r->magic == VC8_RING_MAGIC && !r->closed && r->pid != (uint32_t)getpid()
+				&& (!kill(r->pid, 0) || errno == EPERM))
+			{
+				munmap(p, sizeof(*r));
+				close(fd);
+				errno = EBUSY;
+				return NULL;
+			}
+			__atomic_store_n(&r->closed, 1, __ATOMIC_SEQ_CST);
+			vc8_ring_wake(r);
+			munmap(p, sizeof(*r));
+		}
+		close(fd);
+		shm_unlink(path);
+	}
+	if ((fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0644)) < 0)
+		return NULL;
+	if (ftruncate(fd, bytes)
+		|| (p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		close(fd);
+		shm_unlink(path);
+		return NULL;
+	}
+	close(fd);
+	r = (struct vc8_ring*)p;
+	r->size = size;
+	r->pid = getpid();
+	r->version = VC8_RING_VERSION;
+	__atomic_store_n(&r->magic, VC8_RING_MAGIC, __ATOMIC_RELEASE);
+	return r;
+}
+
+static inline void vc8_ring_wake(struct vc8_ring* r)
+{
+	syscall(SYS_futex, &r->head, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Put one point. Returns 0 if the ring is full and the point was dropped.
+static inline int vc8_ring_put(struct vc8_ring* r, unsigned x, unsigned y)
+{
+	uint32_t h = r->head;
+
+	if (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->size)
+	{
+		r->dropped++;
+		return 0;
+	}
+	r->points[h & (r->size - 1)] = (x & 1023) | (y & 1023) << 16;
+	__atomic_store_n(&r->head, h + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST))
+	{
+		r->waiting = 0;
+		vc8_ring_wake(r);
+	}
+	return 1;
+}
+
+static inline unsigned vc8_ring_sr(const struct vc8_ring* r)
+{
+	return r->sr & 07777;
+}
+
+// Tell the viewer there is no more, and remove the ring.
+static inline void vc8_ring_close(struct vc8_ring* r, const char* name)
+{
+	char path[256] = "/";
+
+	__atomic_store_n(&r->closed, 1, __ATOMIC_SEQ_CST);
+	vc8_ring_wake(r);
+	strncat(path, name, sizeof(path) - 2);
+	shm_unlink(path);
+	munmap(r, sizeof(*r) + r->size * sizeof(uint32_t));
+}
+
+#endif
@@ -0,0 +1,133 @@
+/* vc8_shm.h
+
+Part of VC8_Remote, under the same licence as vc8_remote.cpp.
+
+*/
+
+/*
+	The frame export of vc8_remote -e <name> (Linux only), for programs that want
+	the VC8 picture without grabbing the screen: OBS, a kiosk compositor, an analyser.
+	*
+	* The viewer makes the POSIX shared memory object /<name> holding this header
+	* followed by two frame buffers of buffer_size bytes each. Every frame it copies
+	* the selected host's tile into the buffer the readers are not looking at, and
+	* never waits for them.
+	*
+	* Each buffer has a sequence count that is odd while the viewer is writing it
+	* (a seqlock). A reader:
+	*   1. waits for frame to change (vc8_shm_wait(), a futex on frame),
+	*   2. takes b = current and s = seq[b]; if s is odd it goes back to 1,
+	*   3. uses info[b] and the pixels in place, with no copy,
+	*   4. checks that seq[b] is still s. If not, the viewer came back round to the
+	*      buffer meanwhile and what was read must be thrown away.
+	* A reader has about a frame's time for step 3 before that can happen.
+	*
+	* The pixels are VC8_SHM_XRGB8888: 32 bits, 0x00RRGGBB in memory order
+	* B G R X, the same as SDL_PIXELFORMAT_RGB888 and DRM_FORMAT_XRGB8888.
+	*
+	* Build a reader with: gcc -o reader reader.c -lrt
+*/
+
+#ifndef VC8_SHM_H
+#define VC8_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define VC8_SHM_MAGIC 0x46384356		// "VC8F"
+#define VC8_SHM_VERSION 1
+#define VC8_SHM_XRGB8888 0x34325258		// "XR24", as DRM_FORMAT_XRGB8888
+
+struct vc8_shm_frame {
+	uint32_t width, height;		// Pixels in the frame
+	uint32_t stride;			// Bytes from one row to the next
+	uint32_t format;			// VC8_SHM_XRGB8888
+	uint64_t frame;				// Frame number, counts up from 1
+	uint64_t time_us;			// When it was made, CLOCK_MONOTONIC
+};
+
+struct vc8_shm_header {
+	uint32_t magic;				// VC8_SHM_MAGIC
+	uint32_t version;			// VC8_SHM_VERSION
+	uint32_t header_size;		// Offset of buffer 0, a whole number of pages
+	uint32_t buffer_size;		// Bytes in a buffer; buffer 1 follows buffer 0
+	volatile uint32_t frame;	// Frames exported, low 32 bits; the futex word
+	volatile uint32_t current;	// Buffer holding the newest frame
+	volatile uint32_t seq[2];	// Odd while the viewer writes the buffer
+	struct vc8_shm_frame info[2];
+	uint32_t pid;				// The viewer writing it
+};
+
+// Map the export called name. Returns NULL if there is none (yet).
+static inline struct vc8_shm_header* vc8_shm_open(const char* name)
+{
+	char path[256] = "/";
+	struct stat st;
+	struct vc8_shm_header* h;
+	void* p;
+	int fd;
+
+	strncat(path, name, sizeof(path) - 2);
+	if ((fd = shm_open(path, O_RDONLY, 0)) < 0)
+		return NULL;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*h))
+	{
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+	h = (struct vc8_shm_header*)p;
+	if (h->magic != VC8_SHM_MAGIC || h->version != VC8_SHM_VERSION
+		|| (off_t)h->header_size + 2 * (off_t)h->buffer_size > st.st_size)
+	{
+		munmap(p, st.st_size);
+		return NULL;
+	}
+	return h;
+}
+
+// The pixels of buffer b.
+static inline const uint8_t* vc8_shm_pixels(const struct vc8_shm_header* h, uint32_t b)
+{
+	return (const uint8_t*)h + h->header_size + b * h->buffer_size;
+}
+
+// Wait up to ms for frame to move on from last. Returns the new frame count.
+static inline uint32_t vc8_shm_wait(const struct vc8_shm_header* h, uint32_t last, int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	if (h->frame == last)
+		syscall(SYS_futex, &h->frame, FUTEX_WAIT, last, &ts, NULL, 0);
+	return h->frame;
+}
+
+// Steps 2 and 4 of the protocol above.
+static inline int vc8_shm_begin(const struct vc8_shm_header* h, uint32_t* b, uint32_t* seq)
+{
+	*b = h->current & 1;
+	*seq = h->seq[*b];
+	__sync_synchronize();
+	return !(*seq & 1);
+}
+
+static inline int vc8_shm_end(const struct vc8_shm_header* h, uint32_t b, uint32_t seq)
+{
+	__sync_synchronize();
+	return h->seq[b] == seq;
+}
+
+#endif
@@ -0,0 +1,46 @@
+/* vc8_udp.h
+
+Part of VC8_Remote, under the same licence as vc8_remote.cpp.
+
+*/
+
+/*
+	The datagrams of the UDP transport, used by vc8_remote (host udp:<relay>[:port])
+	and vc8_relay, which runs next to the PiDP8I and turns its TCP stream into them.
+	*
+	* Over TCP a lost segment holds back every point after it until it is sent
+	* again, and on a poor wireless link the picture freezes. Over UDP a lost batch
+	* is just a few missing points.
+	*
+	* Every datagram starts with a vc8_udp_header. All fields are little endian.
+	* VC8_UDP_POINTS: relay -> viewer, count points (x | y << 16, 10 bits each)
+	*   follow. seq counts the batches, so the viewer can tell lost, duplicated
+	*   and late ones.
+	* VC8_UDP_SR: viewer -> relay, count is the switch register. seq goes up by one
+	*   for each change. The viewer sends each change VC8_UDP_SR_COPIES times,
+	*   VC8_UDP_SR_GAP_MS apart, and the latest again every VC8_UDP_KEEPALIVE_MS.
+	*   The relay sends the points to wherever these come from and passes on
+	*   each change once.
+*/
+
+#ifndef VC8_UDP_H
+#define VC8_UDP_H
+
+#include <stdint.h>
+
+#define VC8_UDP_VERSION 1
+#define VC8_UDP_POINTS 1
+#define VC8_UDP_SR 2
+#define VC8_UDP_MAX_POINTS 256		// Most points in a batch (1032 bytes)
+#define VC8_UDP_SR_COPIES 3
+#define VC8_UDP_SR_GAP_MS 10
+#define VC8_UDP_KEEPALIVE_MS 1000
+
+struct vc8_udp_header {
+	uint8_t type;				// VC8_UDP_POINTS or VC8_UDP_SR
+	uint8_t version;			// VC8_UDP_VERSION
+	uint16_t count;				// Points that follow, or the switch register
+	uint32_t seq;
+};
+
+#endif